@@ -8,8 +8,8 @@ tdchung.9@gmail.com
 
 */
 
-#include "Arduino.h"
 #include "ArduhdlcSw.h"
+#include "HdlcCapture.h"
 
 /* HDLC Asynchronous framing */
 /* The frame boundary octet is 01111110, (7E in hexadecimal notation) */
@@ -23,7 +23,7 @@ tdchung.9@gmail.com
 #define INVERT_OCTET 0x20
 
 /* The frame check sequence (FCS) is a 16-bit CRC-CCITT */
-/* AVR Libc CRC function is _crc_ccitt_update() */
+/* Computed by crc16_update(), CRC-16/CCITT-FALSE, no AVR Libc needed */
 /* Corresponding CRC function in Qt (www.qt.io) is qChecksum() */
 #define CRC16_CCITT_INIT_VAL 0xFFFF
 
@@ -41,21 +41,48 @@ ArduhdlcSw::ArduhdlcSw (sendchar_type put_char,
 	this->max_frame_length = max_frame_length;
 	this->receive_frame_buffer = (uint8_t *)malloc(max_frame_length+1); // char *ab = (char*)malloc(12);
     this->frame_checksum = CRC16_CCITT_INIT_VAL;
-    this->escape_character = false;
+    this->rx_state = RX_HUNT;
+    this->nak_enabled = false;
+    memset(&this->rx_errors, 0, sizeof(this->rx_errors));
+    this->capture = NULL;
+    memset(this->tx_queue, 0, sizeof(this->tx_queue));
+    this->tx_queue_storage = NULL;
+    this->tx_queue_depth = 0;
+    this->tx_queue_frame_length = 0;
+    this->tx_room_function = NULL;
+    this->tx_state = TX_IDLE;
+    this->tx_current = NULL;
+    this->tx_position = 0;
+    this->tx_fcs = CRC16_CCITT_INIT_VAL;
+    this->tx_escape_pending = false;
+    this->tx_pending_byte = 0;
+}
+
+ArduhdlcSw::~ArduhdlcSw ()
+{
+    free(this->receive_frame_buffer);
+    free(this->tx_queue_storage);
 }
 
 // tdchung
 // Algorithm  CRC-16/CCITT-FALSE
-uint16_t ArduhdlcSw::crc16(char* pData, int length)
+uint16_t ArduhdlcSw::crc16(const char* pData, int length)
 {
-    uint8_t i;
     uint16_t wCrc = CRC16_CCITT_INIT_VAL;
     while (length--) {
-        wCrc ^= *(unsigned char *)pData++ << 8;
-        for (i=0; i < 8; i++)
-            wCrc = wCrc & 0x8000 ? (wCrc << 1) ^ 0x1021 : wCrc << 1;
+        wCrc = this->crc16_update(wCrc, *(const unsigned char *)pData++);
     }
-    return wCrc & CRC16_CCITT_INIT_VAL;
+    return wCrc;
+}
+
+// one byte step of crc16(), lets the encoder run the FCS as it goes
+uint16_t ArduhdlcSw::crc16_update(uint16_t crc, uint8_t data)
+{
+    uint8_t i;
+    crc ^= (uint16_t)data << 8;
+    for (i=0; i < 8; i++)
+        crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    return crc & CRC16_CCITT_INIT_VAL;
 }
 
 /* Function to send a byte throug USART, I2C, SPI etc.*/
@@ -65,72 +92,118 @@ void ArduhdlcSw::sendchar(uint8_t data)
 }
 
 /* Function to find valid HDLC frame from incoming data */
+/* RX_HUNT drops everything up to the next flag, so an overflow or abort */
+/* costs only the damaged frame, never the one after it */
 void ArduhdlcSw::charReceiver(uint8_t data)
 {
+    if (this->capture)
+    {
+        this->capture->rawByte(data);
+    }
+
     /* FRAME FLAG */
     if(data == FRAME_BOUNDARY_OCTET)
     {
-        if(this->escape_character == true)
+        if (RX_ESCAPE == this->rx_state)
         {
-            this->escape_character = false;
+            // 0x7D 0x7E aborts the frame, the flag still opens the next one
+            this->rx_errors.aborts++;
+            this->rx_error(HDLC_NAK_ABORT);
         }
-        /* If a valid frame is detected */
-        // tdchung, update hander frame
-        else if( (this->frame_position >= 2)
-                //   &&
-                //   ( this->frame_checksum == ((this->receive_frame_buffer[this->frame_position-1] << 8 ) |
-                //   (this->receive_frame_buffer[this->frame_position-2] & 0xff)) ) 
-                )  // (msb << 8 ) | (lsb & 0xff)
+        else if ((RX_DATA == this->rx_state) && (this->frame_position >= 2))
         {
-            /* Call the user defined function and pass frame to it */
-            // (*frame_handler)(receive_frame_buffer,(uint8_t)(this->frame_position-2));
-
-            // tdchung, update check crc
-            uint16_t fcs = this->crc16(receive_frame_buffer, frame_position-2);
-            // 
-            // if (fcs == ((this->receive_frame_buffer[this->frame_position-1] << 8 )
-            //             | (this->receive_frame_buffer[this->frame_position-2] & 0xff)))
-            if (fcs == ((this->receive_frame_buffer[this->frame_position-1] ) 
+            // frame_checksum trails two octets behind, the FCS is not in it
+            if (this->frame_checksum == ((this->receive_frame_buffer[this->frame_position-1] )
                         | (this->receive_frame_buffer[this->frame_position-2] << 8)))
             {
-                (*frame_handler)(receive_frame_buffer,(uint8_t)(this->frame_position));
+                this->rx_errors.frames_ok++;
+                if (this->capture)
+                {
+                    this->capture->frame(receive_frame_buffer, this->frame_position, 0);
+                }
+                (*frame_handler)(receive_frame_buffer, this->frame_position);
             }
             else
             {
                 // crc not match
+                if (this->capture)
+                {
+                    this->capture->frame(receive_frame_buffer, this->frame_position, HDLC_CAPTURE_FLAG_BAD_FCS);
+                }
+                this->rx_errors.crc_errors++;
+                this->rx_error(HDLC_NAK_CRC);
             }
         }
+        else if ((RX_DATA == this->rx_state) && (1 == this->frame_position))
+        {
+            this->rx_errors.runts++;
+        }
+        this->rx_state = RX_DATA;
         this->frame_position = 0;
         this->frame_checksum = CRC16_CCITT_INIT_VAL;
         return;
     }
 
-    if(this->escape_character)
+    if (RX_HUNT == this->rx_state)
+    {
+        this->rx_errors.hunt_octets++;
+        return;
+    }
+
+    if (RX_ESCAPE == this->rx_state)
     {
-        this->escape_character = false;
+        this->rx_state = RX_DATA;
         data ^= INVERT_OCTET;
     }
     else if(data == CONTROL_ESCAPE_OCTET)
     {
-        this->escape_character = true;
+        this->rx_state = RX_ESCAPE;
+        return;
+    }
+
+    if (this->frame_position == this->max_frame_length)
+    {
+        // too long, no frame boundary was seen; wait for the next flag
+        this->rx_errors.overflows++;
+        this->rx_error(HDLC_NAK_OVERFLOW);
+        this->rx_state = RX_HUNT;
         return;
     }
 
     receive_frame_buffer[this->frame_position] = data;
 
-    if(this->frame_position-2 >= 0) {
-        this->frame_checksum = _crc_ccitt_update(this->frame_checksum, receive_frame_buffer[this->frame_position-2]);
+    if (this->frame_position >= 2) {
+        this->frame_checksum = this->crc16_update(this->frame_checksum, receive_frame_buffer[this->frame_position-2]);
     }
 
     this->frame_position++;
+}
 
-    if(this->frame_position == this->max_frame_length)
+/* Ask the peer to send again, if enabled. Goes out through the */
+/* transmit queue, so it is safe from the receive path */
+void ArduhdlcSw::rx_error(char reason)
+{
+    if (!this->nak_enabled)
     {
-        this->frame_position = 0;
-        this->frame_checksum = CRC16_CCITT_INIT_VAL;
+        return;
+    }
+    char frame[4] = { SBR_PKT_NTFY_NAK, reason, DEFAUT_ENCODE_SEGMENT[0], DEFAUT_ENCODE_SEGMENT[1] };
+    if (this->queueFrame(frame, sizeof(frame), HDLC_TX_PRIORITY_CONTROL))
+    {
+        this->rx_errors.naks_sent++;
     }
 }
 
+void ArduhdlcSw::setNak(bool enable)
+{
+    this->nak_enabled = enable;
+}
+
+const rx_stats_t * ArduhdlcSw::rxStats(void)
+{
+    return &this->rx_errors;
+}
+
 /* Wrap given data in HDLC frame and send it out byte at a time*/
 void ArduhdlcSw::frameDecode(const char *framebuffer, uint8_t frame_length)
 {
@@ -140,6 +213,12 @@ void ArduhdlcSw::frameDecode(const char *framebuffer, uint8_t frame_length)
     // tdchung. make cpu run slow
     uint16_t fcs = this->crc16(framebuffer, frame_length);
 
+    // finish a frame poll() stopped in, or the two would be sent interleaved
+    while (this->txBusy())
+    {
+        this->tx_octet();
+    }
+
     this->sendchar((uint8_t)FRAME_BOUNDARY_OCTET);
 
     while(frame_length)
@@ -188,6 +267,251 @@ void ArduhdlcSw::frameDecode(const char *framebuffer, uint8_t frame_length)
     this->sendchar(FRAME_BOUNDARY_OCTET);
 }
 
+// Pick the queue for a frame from its packet type, byte 0
+uint8_t ArduhdlcSw::frame_priority(const char *framebuffer)
+{
+    switch (framebuffer[0])
+    {
+        case SBR_PKT_RQST_PUSH:
+            return HDLC_TX_PRIORITY_BULK;
+
+        case SBR_PKT_RQST_INPUT_CREATE:
+        case SBR_PKT_RQST_OUTPUT_CREATE:
+        case SBR_PKT_RQST_DELETE:
+        case SBR_PKT_RQST_HANDLER_ADD:
+        case SBR_PKT_RQST_HANDLER_REMOVE:
+        case SBR_PKT_RQST_GET:
+        case SBR_PKT_RQST_EXAMPLE_SET:
+        case SBR_PKT_RQST_SENSOR_CREATE:
+        case SBR_PKT_RQST_SENSOR_REMOVE:
+        case SBR_PKT_RQST_CAPABILITY:
+        case SBR_PKT_RQST_BAUD_SWITCH:
+        case SBR_PKT_RQST_LINK_PROBE:
+            return HDLC_TX_PRIORITY_NORMAL;
+
+        default:
+            // responses and notifications
+            return HDLC_TX_PRIORITY_CONTROL;
+    }
+}
+
+/* Allocate the transmit queue, one block for all priorities. */
+/* Only while nothing is queued, false if out of memory */
+bool ArduhdlcSw::setTxQueue(uint8_t depth, uint8_t frame_length)
+{
+    if (this->txBusy() || this->queuedFrames(HDLC_TX_PRIORITY_CONTROL)
+            || this->queuedFrames(HDLC_TX_PRIORITY_NORMAL) || this->queuedFrames(HDLC_TX_PRIORITY_BULK))
+    {
+        return false;
+    }
+
+    free(this->tx_queue_storage);
+    this->tx_queue_storage = NULL;
+    this->tx_queue_depth = 0;
+    this->tx_queue_frame_length = 0;
+    if ((0 == depth) || (0 == frame_length))
+    {
+        return true;
+    }
+
+    uint16_t frames = (uint16_t)HDLC_TX_PRIORITY_COUNT * depth;
+    this->tx_queue_storage = (char *)malloc((size_t)frames * (frame_length + 1));
+    if (NULL == this->tx_queue_storage)
+    {
+        return false;
+    }
+    this->tx_queue_depth = depth;
+    this->tx_queue_frame_length = frame_length;
+
+    // frames first, then the length octets
+    uint8_t *lengths = (uint8_t *)(this->tx_queue_storage + (size_t)frames * frame_length);
+    for (uint8_t priority = 0; priority < HDLC_TX_PRIORITY_COUNT; priority++)
+    {
+        tx_queue_t *queue = &this->tx_queue[priority];
+        queue->frame = this->tx_queue_storage + (size_t)priority * depth * frame_length;
+        queue->length = lengths + priority * depth;
+        queue->head = 0;
+        queue->count = 0;
+    }
+    return true;
+}
+
+bool ArduhdlcSw::queueFrame(const char *framebuffer, uint8_t frame_length)
+{
+    if (0 == frame_length)
+    {
+        return false;
+    }
+    return this->queueFrame(framebuffer, frame_length, this->frame_priority(framebuffer));
+}
+
+/* Copy frame into the queue of given priority, false if it does not fit */
+bool ArduhdlcSw::queueFrame(const char *framebuffer, uint8_t frame_length, uint8_t priority)
+{
+    if (priority >= HDLC_TX_PRIORITY_COUNT)
+    {
+        priority = HDLC_TX_PRIORITY_COUNT - 1;
+    }
+    tx_queue_t *queue = &this->tx_queue[priority];
+
+    if ((queue->count == this->tx_queue_depth) || (frame_length > this->tx_queue_frame_length))
+    {
+        queue->stats.dropped++;
+        return false;
+    }
+
+    uint8_t slot = (queue->head + queue->count) % this->tx_queue_depth;
+    memcpy(queue->frame + slot * this->tx_queue_frame_length, framebuffer, frame_length);
+    queue->length[slot] = frame_length;
+    queue->count++;
+
+    queue->stats.queued++;
+    if (queue->count > queue->stats.high_water)
+    {
+        queue->stats.high_water = queue->count;
+    }
+    return true;
+}
+
+/* Emit as many bytes of the current frame as the transport has room for, */
+/* starting the next highest priority frame at a frame boundary. */
+/* Call it from loop(), returns false once the frame and all queues are done */
+bool ArduhdlcSw::poll(void)
+{
+    int room = -1;
+    if (NULL != this->tx_room_function)
+    {
+        room = (*this->tx_room_function)();
+    }
+
+    while (room != 0)
+    {
+        if (!this->txBusy())
+        {
+            this->tx_current = NULL;
+            for (uint8_t priority = 0; priority < HDLC_TX_PRIORITY_COUNT; priority++)
+            {
+                if (this->tx_queue[priority].count)
+                {
+                    this->tx_current = &this->tx_queue[priority];
+                    break;
+                }
+            }
+            if (NULL == this->tx_current)
+            {
+                return false;
+            }
+            this->tx_position = 0;
+            this->tx_fcs = CRC16_CCITT_INIT_VAL;
+            this->tx_state = TX_START_FLAG;
+        }
+
+        this->tx_octet();
+        if (room > 0) room--;
+    }
+    return true;
+}
+
+/* Send the next octet of the frame poll() is on */
+void ArduhdlcSw::tx_octet(void)
+{
+    if (this->tx_escape_pending)
+    {
+        this->sendchar(this->tx_pending_byte);
+        this->tx_escape_pending = false;
+        return;
+    }
+
+    tx_queue_t *queue = this->tx_current;
+    uint8_t slot = queue->head;
+    uint8_t data;
+
+    switch (this->tx_state)
+    {
+        case TX_START_FLAG:
+            this->sendchar((uint8_t)FRAME_BOUNDARY_OCTET);
+            this->tx_state = TX_DATA;
+            break;
+
+        case TX_DATA:
+            if (this->tx_position < queue->length[slot])
+            {
+                data = (uint8_t)queue->frame[slot * this->tx_queue_frame_length + this->tx_position++];
+                this->tx_fcs = this->crc16_update(this->tx_fcs, data);
+                this->tx_stuff(data);
+                break;
+            }
+            this->tx_state = TX_FCS_HIGH;
+            // fall through
+
+        case TX_FCS_HIGH:
+            this->tx_stuff(high(this->tx_fcs));
+            this->tx_state = TX_FCS_LOW;
+            break;
+
+        case TX_FCS_LOW:
+            this->tx_stuff(low(this->tx_fcs));
+            this->tx_state = TX_END_FLAG;
+            break;
+
+        case TX_END_FLAG:
+        default:
+            this->sendchar((uint8_t)FRAME_BOUNDARY_OCTET);
+            queue->head = (slot + 1) % this->tx_queue_depth;
+            queue->count--;
+            queue->stats.sent++;
+            this->tx_current = NULL;
+            this->tx_state = TX_IDLE;
+            break;
+    }
+}
+
+/* Send one data or FCS octet, escaping it over two poll steps if needed */
+void ArduhdlcSw::tx_stuff(uint8_t data)
+{
+    if ((data == CONTROL_ESCAPE_OCTET) || (data == FRAME_BOUNDARY_OCTET))
+    {
+        this->sendchar((uint8_t)CONTROL_ESCAPE_OCTET);
+        this->tx_pending_byte = data ^ INVERT_OCTET;
+        this->tx_escape_pending = true;
+        return;
+    }
+    this->sendchar(data);
+}
+
+bool ArduhdlcSw::txBusy(void)
+{
+    return (TX_IDLE != this->tx_state) || this->tx_escape_pending;
+}
+
+void ArduhdlcSw::setTxRoomFunction(tx_room_type tx_room)
+{
+    this->tx_room_function = tx_room;
+}
+
+uint8_t ArduhdlcSw::queuedFrames(uint8_t priority)
+{
+    if (priority >= HDLC_TX_PRIORITY_COUNT)
+    {
+        return 0;
+    }
+    return this->tx_queue[priority].count;
+}
+
+const tx_queue_stats_t * ArduhdlcSw::queueStats(uint8_t priority)
+{
+    if (priority >= HDLC_TX_PRIORITY_COUNT)
+    {
+        return NULL;
+    }
+    return &this->tx_queue[priority].stats;
+}
+
+void ArduhdlcSw::setCapture(HdlcCapture *capture)
+{
+    this->capture = capture;
+}
+
 // privite function
 // split string c
 char** ArduhdlcSw::str_split(char* a_str, const char a_delim)
@@ -218,7 +542,7 @@ char** ArduhdlcSw::str_split(char* a_str, const char a_delim)
        knows where the list of returned strings ends. */
     count++;
 
-    result = malloc(sizeof(char*) * count);
+    result = (char**)malloc(sizeof(char*) * count);
 
     if (result)
     {
@@ -604,11 +928,6 @@ int ArduhdlcSw::get_resp_path(char* data, int length, char* dataout)
                 strcpy(dataout, string+1);
                 result = 1;
             }
-            else
-            {
-                result = 0;
-                // invalid data path
-            }
 
             free(*(tokens + i));
         }
@@ -643,11 +962,6 @@ int ArduhdlcSw::get_resp_timestamp(char* data, int length, char* dataout)
                 strcpy(dataout, string+1);
                 result = 1;
             }
-            else
-            {
-                result = 0;
-                // invalid data path
-            }
 
             free(*(tokens + i));
         }
@@ -682,11 +996,6 @@ int ArduhdlcSw::get_resp_data(char* data, int length, char* dataout)
                 strcpy(dataout, string+1);
                 result = 1;
             }
-            else
-            {
-                result = 0;
-                // invalid data path
-            }
 
             free(*(tokens + i));
         }
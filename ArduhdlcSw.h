@@ -1,11 +1,17 @@
 #ifndef arduhdlcSw_h
 #define arduhdlcSw_h
 
+#ifdef ARDUINO
 #include "Arduino.h"
+#else
+// host build, e.g. Linux gateway
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#endif
 #include <stdint.h>
 #include <stdbool.h>
 #include <assert.h>
-#include <util/crc16.h>
 
 
 #define DEFAUT_ENCODE_SEGMENT       "01"
@@ -47,13 +53,40 @@
 #define SBR_PKT_NTFY_SENSOR_CALL    'b'   // type[1] pad[1]    pad[2] path[]
 #define SBR_PKT_RESP_SENSOR_CALL    'B'   // type[1] status[1] pad[2]
 
+#define SBR_PKT_RQST_CAPABILITY     'N'   // type[1] pad[1]    pad[2] length[] crc[] features[] baud[]
+#define SBR_PKT_RESP_CAPABILITY     'n'   // type[1] status[1] pad[2] length[] crc[] features[] baud[]
+
+#define SBR_PKT_RQST_BAUD_SWITCH    'A'   // type[1] pad[1]    pad[2] baud[] count[]
+#define SBR_PKT_RESP_BAUD_SWITCH    'a'   // type[1] status[1] pad[2] count[]
+
+#define SBR_PKT_RQST_LINK_PROBE     'L'   // type[1] pad[1]    pad[2] count[] data[]
+#define SBR_PKT_RESP_LINK_PROBE     'l'   // type[1] status[1] pad[2] count[]
+
 #define SBR_PKT_RESP_UNKNOWN_RQST   '?'   // type[1] status[1] pad[2]
 
+#define SBR_PKT_NTFY_NAK            '!'   // type[1] reason[1] pad[2], last frame lost, send again
+
+// NAK reason - byte 1
+#define HDLC_NAK_CRC                'C'
+#define HDLC_NAK_OVERFLOW           'O'   // longer than max_frame_length
+#define HDLC_NAK_ABORT              'A'   // 0x7D 0x7E abort sequence
+
 // Variable length field identifiers
 #define SBR_FIELD_ID_PATH           'P'
 #define SBR_FIELD_ID_TIME           'T'
 #define SBR_FIELD_ID_UNITS          'U'
 #define SBR_FIELD_ID_DATA           'D'
+#define SBR_FIELD_ID_LENGTH         'M'   // max frame length
+#define SBR_FIELD_ID_CRC            'C'   // CRC variants, most preferred first
+#define SBR_FIELD_ID_FEATURES       'F'   // optional feature letters
+#define SBR_FIELD_ID_BAUD           'R'
+#define SBR_FIELD_ID_COUNT          'Q'   // probe or 'A' sequence / probes received
+
+// Response status field - byte 1
+#define SBR_STATUS_OK               '0'
+#define SBR_STATUS_NOT_FOUND        'N'   // no resource at path
+#define SBR_STATUS_NO_MEMORY        'M'   // resource table full
+#define SBR_STATUS_BAD_REQUEST      'F'   // malformed or unknown request
 
 // Data type field - byte 1
 #define SBR_DATA_TYPE_TRIGGER       'T'   // trigger - no data
@@ -83,18 +116,104 @@ typedef enum
     REQUEST_EXAMPLE= 5 
 } request_package_t;
 
+// Transmit queue priorities - lower value is sent first
+#define HDLC_TX_PRIORITY_CONTROL    0     // responses and notifications
+#define HDLC_TX_PRIORITY_NORMAL     1     // requests
+#define HDLC_TX_PRIORITY_BULK       2     // SBR_PKT_RQST_PUSH
+#define HDLC_TX_PRIORITY_COUNT      3
+
+// Suggested setTxQueue() sizes, frames per priority and octets per frame.
+// HDLC_TX_QUEUE_FRAME_LENGTH is also the longest frame the library builds
+#define HDLC_TX_QUEUE_DEPTH         2
+#define HDLC_TX_QUEUE_FRAME_LENGTH  128
+
+typedef struct
+{
+    uint32_t queued;        // frames accepted
+    uint32_t sent;          // frames handed to the framer
+    uint32_t dropped;       // frames rejected, queue full or too long
+    uint8_t  high_water;    // max frames waiting at once
+} tx_queue_stats_t;
+
+typedef struct
+{
+    char *   frame;         // depth slots of frame_length octets
+    uint8_t *length;
+    uint8_t  head;
+    uint8_t  count;
+    tx_queue_stats_t stats;
+} tx_queue_t;
 
 
 typedef void (* sendchar_type) (uint8_t);
 typedef void (* frame_handler_type)(const uint8_t *framebuffer, uint16_t framelength);
+typedef int (* tx_room_type)(void);
+typedef unsigned long (* clock_type)(void);    // e.g. millis, micros
+
+class HdlcCapture;
+
+// Receiver state
+typedef enum
+{
+    RX_HUNT = 0,            // discarding until the next flag
+    RX_DATA,
+    RX_ESCAPE               // 0x7D seen
+} rx_state_t;
+
+typedef struct
+{
+    uint32_t frames_ok;
+    uint32_t crc_errors;
+    uint32_t aborts;
+    uint32_t overflows;
+    uint32_t runts;         // single octet between flags
+    uint32_t hunt_octets;   // dropped while hunting for a flag
+    uint32_t naks_sent;
+} rx_stats_t;
+
+// Resumable transmit encoder state
+typedef enum
+{
+    TX_IDLE = 0,
+    TX_START_FLAG,
+    TX_DATA,
+    TX_FCS_HIGH,
+    TX_FCS_LOW,
+    TX_END_FLAG
+} tx_state_t;
 
 class ArduhdlcSw
 {
   public:
     ArduhdlcSw (sendchar_type, frame_handler_type, uint16_t max_frame_length);
+    ~ArduhdlcSw ();
     void charReceiver(uint8_t data);
+    /* Sends at once, blocking. A frame poll() left half sent goes first */
     void frameDecode(const char *framebuffer, uint8_t frame_length);
 
+    /* Priority transmit queue. Frames are copied in and sent by poll(), */
+    /* highest priority first, so responses never wait behind bulk pushes. */
+    /* Takes no RAM until setTxQueue() allocates depth frames per priority */
+    bool setTxQueue(uint8_t depth, uint8_t frame_length);
+    bool queueFrame(const char *framebuffer, uint8_t frame_length);
+    bool queueFrame(const char *framebuffer, uint8_t frame_length, uint8_t priority);
+    bool poll(void);
+    bool txBusy(void);
+
+    /* Optional, returns how many bytes the transport takes without blocking, */
+    /* e.g. Serial.availableForWrite(). poll() then never stalls loop() */
+    void setTxRoomFunction(tx_room_type tx_room);
+    uint8_t queuedFrames(uint8_t priority);
+    const tx_queue_stats_t * queueStats(uint8_t priority);
+
+    /* Queue a SBR_PKT_NTFY_NAK for every damaged frame, off by default, */
+    /* needs setTxQueue() */
+    void setNak(bool enable);
+    const rx_stats_t * rxStats(void);
+
+    /* Record every received byte and frame, NULL to stop */
+    void setCapture(HdlcCapture *capture);
+
     //tdchung
     char encode_dtype(int data_type); // move to private
     int encode_create( char* type, int dtype, char* path, char* unit, char* output);
@@ -119,15 +238,38 @@ class ArduhdlcSw
     frame_handler_type frame_handler;
     void sendchar(uint8_t data);
 
-    bool escape_character;
+    rx_state_t rx_state;
     uint8_t * receive_frame_buffer;
-    uint8_t frame_position;
-    // 16bit CRC sum for _crc_ccitt_update
+    uint16_t frame_position;
+    // 16bit CRC sum for crc16_update
     uint16_t frame_checksum;
 	uint16_t max_frame_length;
+    HdlcCapture * capture;
+
+    bool nak_enabled;
+    rx_stats_t rx_errors;
+    void rx_error(char reason);
+
+    tx_queue_t tx_queue[HDLC_TX_PRIORITY_COUNT];
+    char * tx_queue_storage;
+    uint8_t tx_queue_depth;
+    uint8_t tx_queue_frame_length;
+    uint8_t frame_priority(const char *framebuffer);
+
+    // frame being sent by poll(), stays in its queue slot until done
+    tx_room_type tx_room_function;
+    tx_state_t tx_state;
+    tx_queue_t * tx_current;
+    uint8_t tx_position;
+    uint16_t tx_fcs;
+    bool tx_escape_pending;
+    uint8_t tx_pending_byte;
+    void tx_octet(void);
+    void tx_stuff(uint8_t data);
 
     // tdchung
-    uint16_t crc16(char* pData, int length);
+    uint16_t crc16(const char* pData, int length);
+    uint16_t crc16_update(uint16_t crc, uint8_t data);
     char** str_split(char* a_str, const char a_delim);
 
 };
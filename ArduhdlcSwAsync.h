@@ -0,0 +1,701 @@
+#ifndef arduhdlcSwAsync_h
+#define arduhdlcSwAsync_h
+
+/*
+Coroutine request API for the host build (Linux gateway side).
+
+    arduhdlc::EventLoop loop;
+    arduhdlc::Link link(loop, fd);
+    auto v = co_await link.get("path/to/get");
+
+Everything runs on one thread: a Link owns its ArduhdlcSw, reads and writes
+a non-blocking fd through the loop, and matches each response to the oldest
+pending request of the same type ('G' -> 'g', 'P' -> 'p', ...). The SBR
+protocol carries no request id, so a request that times out or is cancelled
+leaves a placeholder in its place that takes its late response, for up to
+one more timeout. A '?' reply fails the oldest pending request.
+
+Header only, needs C++20 and is skipped by the Arduino build.
+*/
+
+#if !defined(ARDUINO) && (__cplusplus >= 202002L)
+
+#include "ArduhdlcSw.h"
+
+#include <chrono>
+#include <coroutine>
+#include <ctype.h>
+#include <deque>
+#include <errno.h>
+#include <exception>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <poll.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace arduhdlc
+{
+
+class EventLoop;
+
+template <typename T> class Task;
+
+namespace detail
+{
+
+struct PromiseBase
+{
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+    EventLoop * loop = nullptr;     // set when spawned, task owns itself
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+void task_finished(EventLoop * loop);
+
+template <typename Promise>
+struct FinalAwaiter
+{
+    bool await_ready() noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept
+    {
+        PromiseBase & p = h.promise();
+        if (p.continuation)
+        {
+            return p.continuation;
+        }
+        if (p.loop)
+        {
+            EventLoop * loop = p.loop;
+            h.destroy();
+            task_finished(loop);
+        }
+        return std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+};
+
+template <typename T>
+struct Promise : PromiseBase
+{
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+    FinalAwaiter<Promise> final_suspend() noexcept { return {}; }
+    void return_value(T v) { value = std::move(v); }
+    T result()
+    {
+        if (error) std::rethrow_exception(error);
+        return std::move(*value);
+    }
+};
+
+template <>
+struct Promise<void> : PromiseBase
+{
+    Task<void> get_return_object();
+    FinalAwaiter<Promise> final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void result()
+    {
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+} // namespace detail
+
+/* Lazily started coroutine, runs when awaited or spawned on a loop */
+template <typename T = void>
+class Task
+{
+  public:
+    using promise_type = detail::Promise<T>;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    explicit Task(handle_type h) : handle(h) {}
+    Task(Task && other) noexcept : handle(other.handle) { other.handle = nullptr; }
+    Task(const Task &) = delete;
+    Task & operator=(const Task &) = delete;
+    ~Task() { if (handle) handle.destroy(); }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+    T await_resume() { return handle.promise().result(); }
+
+    handle_type release() { handle_type h = handle; handle = nullptr; return h; }
+
+  private:
+    handle_type handle;
+};
+
+template <typename T>
+Task<T> detail::Promise<T>::get_return_object()
+{
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> detail::Promise<void>::get_return_object()
+{
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+/* Single-threaded loop: ready coroutines, timers and fd readiness */
+class EventLoop
+{
+  public:
+    using Clock = std::chrono::steady_clock;
+    using Timers = std::multimap<Clock::time_point, std::function<void()>>;
+    using TimerId = Timers::iterator;
+    using FdHandler = std::function<void(short revents)>;
+
+    TimerId addTimer(Clock::duration delay, std::function<void()> fn)
+    {
+        return timers.emplace(Clock::now() + delay, std::move(fn));
+    }
+
+    void cancelTimer(TimerId id) { timers.erase(id); }
+
+    void post(std::coroutine_handle<> h) { ready.push_back(h); }
+
+    /* events is POLLIN and/or POLLOUT, 0 keeps the fd registered but idle */
+    void watch(int fd, short events, FdHandler fn) { fds[fd] = Watch{ events, std::move(fn) }; }
+    void setEvents(int fd, short events)
+    {
+        auto it = fds.find(fd);
+        if (it != fds.end()) it->second.events = events;
+    }
+    void unwatch(int fd) { fds.erase(fd); }
+
+    /* Start a detached task, the loop owns it until it finishes */
+    void spawn(Task<void> task)
+    {
+        auto h = task.release();
+        h.promise().loop = this;
+        alive_tasks++;
+        post(h);
+    }
+
+    /* Run until every spawned task has finished or stop() is called */
+    void run()
+    {
+        stopped = false;
+        while (!stopped && (alive_tasks > 0 || !ready.empty()))
+        {
+            runOnce(-1);
+        }
+    }
+
+    void stop() { stopped = true; }
+
+    /* One iteration, waits at most max_wait_ms (-1 = until a timer or fd fires, */
+    /* but never once all spawned tasks are done) */
+    void runOnce(int max_wait_ms)
+    {
+        while (!ready.empty())
+        {
+            std::coroutine_handle<> h = ready.front();
+            ready.pop_front();
+            h.resume();
+        }
+
+        fireTimers();
+        if (!ready.empty() || stopped || (0 == alive_tasks && max_wait_ms < 0))
+        {
+            return;
+        }
+
+        int wait_ms = max_wait_ms;
+        if (!timers.empty())
+        {
+            auto until = std::chrono::ceil<std::chrono::milliseconds>(timers.begin()->first - Clock::now()).count();
+            if (until < 0) until = 0;
+            if (wait_ms < 0 || until < wait_ms) wait_ms = (int)until;
+        }
+
+        poll_set.clear();
+        for (auto & f : fds)
+        {
+            if (f.second.events) poll_set.push_back(pollfd{ f.first, f.second.events, 0 });
+        }
+        if (poll_set.empty() && wait_ms < 0)
+        {
+            return;
+        }
+
+        int n = ::poll(poll_set.data(), poll_set.size(), wait_ms);
+        if (n > 0)
+        {
+            for (const pollfd & p : poll_set)
+            {
+                if (!p.revents) continue;
+                auto it = fds.find(p.fd);
+                if (it != fds.end())
+                {
+                    FdHandler fn = it->second.fn;   // handler may unwatch itself
+                    fn(p.revents);
+                }
+            }
+        }
+        fireTimers();
+    }
+
+  private:
+    friend void detail::task_finished(EventLoop * loop);
+
+    struct Watch
+    {
+        short events;
+        FdHandler fn;
+    };
+
+    void fireTimers()
+    {
+        Clock::time_point now = Clock::now();
+        while (!timers.empty() && timers.begin()->first <= now)
+        {
+            std::function<void()> fn = std::move(timers.begin()->second);
+            timers.erase(timers.begin());
+            fn();
+        }
+    }
+
+    std::deque<std::coroutine_handle<>> ready;
+    Timers timers;
+    std::map<int, Watch> fds;
+    std::vector<pollfd> poll_set;
+    size_t alive_tasks = 0;
+    bool stopped = false;
+};
+
+inline void detail::task_finished(EventLoop * loop)
+{
+    loop->alive_tasks--;
+}
+
+/* Cancellation, one source may cancel any number of requests */
+class CancelToken
+{
+  public:
+    using Callbacks = std::list<std::function<void()>>;
+
+    CancelToken() = default;
+
+    bool cancelled() const { return state && state->cancelled; }
+    bool valid() const { return (bool)state; }
+
+    Callbacks::iterator onCancel(std::function<void()> fn) { return state->callbacks.insert(state->callbacks.end(), std::move(fn)); }
+    void remove(Callbacks::iterator it) { state->callbacks.erase(it); }
+
+  private:
+    friend class CancelSource;
+
+    struct State
+    {
+        bool cancelled = false;
+        Callbacks callbacks;
+    };
+
+    explicit CancelToken(std::shared_ptr<State> s) : state(std::move(s)) {}
+    std::shared_ptr<State> state;
+};
+
+class CancelSource
+{
+  public:
+    CancelSource() : state(std::make_shared<CancelToken::State>()) {}
+
+    CancelToken token() const { return CancelToken(state); }
+
+    void cancel()
+    {
+        if (state->cancelled) return;
+        state->cancelled = true;
+        CancelToken::Callbacks callbacks;
+        callbacks.swap(state->callbacks);
+        for (auto & fn : callbacks) fn();
+    }
+
+  private:
+    std::shared_ptr<CancelToken::State> state;
+};
+
+enum class Status
+{
+    Ok,
+    Timeout,
+    Cancelled,
+    Closed,
+    Rejected                        // peer answered SBR_PKT_RESP_UNKNOWN_RQST
+};
+
+struct Response
+{
+    Status status = Status::Closed;
+    char packet_type = 0;           // byte 0, e.g. SBR_PKT_RESP_GET
+    char resp_status = 0;           // byte 1
+    std::string path;
+    std::string timestamp;
+    std::string data;
+};
+
+class Link;
+class RequestAwaiter;
+
+namespace detail
+{
+
+/* A request waiting for its response, or with request == nullptr a */
+/* placeholder for one that gave up, so its late response matches nothing */
+struct PendingEntry
+{
+    RequestAwaiter * request;
+    uint64_t sequence;                      // send order, for '?' replies
+    EventLoop::Clock::time_point expires;   // placeholders only
+};
+
+} // namespace detail
+
+/* Returned by Link requests; sends the frame when awaited */
+class RequestAwaiter
+{
+  public:
+    RequestAwaiter(Link * link, std::string frame, EventLoop::Clock::duration timeout, CancelToken token)
+        : link(link), frame(std::move(frame)), timeout(timeout), token(std::move(token)) {}
+
+    RequestAwaiter(const RequestAwaiter &) = delete;
+    RequestAwaiter & operator=(const RequestAwaiter &) = delete;
+
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> h);
+    Response await_resume() { return std::move(result); }
+
+  private:
+    friend class Link;
+
+    Link * link;
+    std::string frame;
+    EventLoop::Clock::duration timeout;
+    CancelToken token;
+
+    Response result;
+    std::coroutine_handle<> waiter;
+    std::list<detail::PendingEntry>::iterator position;
+    EventLoop::TimerId timer;
+    bool timer_armed = false;
+    CancelToken::Callbacks::iterator cancel_entry;
+};
+
+/* One HDLC link over a non-blocking fd (serial port, pty, socket) */
+class Link
+{
+  public:
+    using Duration = EventLoop::Clock::duration;
+    using NotifyHandler = std::function<void(const uint8_t * frame, uint16_t length)>;
+
+    static constexpr Duration default_timeout = std::chrono::seconds(1);
+
+    Link(EventLoop & loop, int fd, uint16_t max_frame_length = 256)
+        : loop(loop), fd(fd), framer(&Link::sendcharTrampoline, &Link::frameTrampoline, max_frame_length)
+    {
+        loop.watch(fd, POLLIN, [this](short revents) { onEvents(revents); });
+    }
+
+    ~Link()
+    {
+        close();
+    }
+
+    Link(const Link &) = delete;
+    Link & operator=(const Link &) = delete;
+
+    RequestAwaiter get(const char * path, Duration timeout = default_timeout, CancelToken token = {})
+    {
+        char frame[DEFAULT_FRAME_LENGTH];
+        framer.encode_get(const_cast<char *>(path), frame);
+        return request(frame, timeout, std::move(token));
+    }
+
+    RequestAwaiter push(int dtype, const char * path, const char * data, Duration timeout = default_timeout, CancelToken token = {})
+    {
+        char frame[DEFAULT_FRAME_LENGTH];
+        framer.encode_push(dtype, const_cast<char *>(path), const_cast<char *>(data), frame);
+        return request(frame, timeout, std::move(token));
+    }
+
+    /* Any request frame built with the encode_*() helpers */
+    RequestAwaiter request(const char * frame, Duration timeout = default_timeout, CancelToken token = {})
+    {
+        return RequestAwaiter(this, std::string(frame), timeout, std::move(token));
+    }
+
+    /* Frames that match no pending request: notifications, late responses */
+    /* (also those taken by a placeholder) */
+    void onNotify(NotifyHandler fn) { notify = std::move(fn); }
+
+    ArduhdlcSw & hdlc() { return framer; }
+
+    size_t pendingRequests() const { return pending_count; }
+
+    /* Stop watching the fd and fail every pending request with Status::Closed */
+    void close()
+    {
+        if (fd < 0) return;
+        loop.unwatch(fd);
+        fd = -1;
+        for (auto & queue : pending)
+        {
+            while (!queue.second.empty())
+            {
+                if (queue.second.front().request)
+                {
+                    complete(queue.second.front().request, Status::Closed);
+                }
+                else
+                {
+                    queue.second.pop_front();
+                }
+            }
+        }
+    }
+
+  private:
+    friend class RequestAwaiter;
+
+    static constexpr int DEFAULT_FRAME_LENGTH = 128;    // encode_*() output limit
+
+    // ArduhdlcSw callbacks carry no context; the loop is single threaded,
+    // so the link calling into its framer is always the one they belong to
+    static inline Link * current = nullptr;
+
+    static void sendcharTrampoline(uint8_t data) { current->out.push_back(data); }
+    static void frameTrampoline(const uint8_t * frame, uint16_t length) { current->onFrame(frame, length); }
+
+    void send(const std::string & frame)
+    {
+        Link * saved = current;
+        current = this;
+        framer.frameDecode(frame.data(), (uint8_t)frame.size());
+        current = saved;
+        flush();
+    }
+
+    void flush()
+    {
+        while (!out.empty() && fd >= 0)
+        {
+            ssize_t n = ::write(fd, out.data(), out.size());
+            if (n <= 0)
+            {
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                if (n < 0 && errno == EINTR) continue;
+                close();
+                return;
+            }
+            out.erase(out.begin(), out.begin() + n);
+        }
+        if (fd >= 0) loop.setEvents(fd, out.empty() ? POLLIN : (POLLIN | POLLOUT));
+    }
+
+    void onEvents(short revents)
+    {
+        if (revents & POLLOUT)
+        {
+            flush();
+        }
+        if (revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            uint8_t buffer[512];
+            ssize_t n = ::read(fd, buffer, sizeof(buffer));
+            if (n <= 0)
+            {
+                if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+                close();
+                return;
+            }
+            Link * saved = current;
+            current = this;
+            for (ssize_t i = 0; i < n; i++)
+            {
+                framer.charReceiver(buffer[i]);
+            }
+            current = saved;
+        }
+    }
+
+    // length includes the 2 FCS octets
+    void onFrame(const uint8_t * frame, uint16_t length)
+    {
+        if (length < 2) return;
+        uint16_t payload = length - 2;
+
+        if (payload && (SBR_PKT_RESP_UNKNOWN_RQST == (char)frame[0]))
+        {
+            onReject(frame, payload);
+            return;
+        }
+
+        auto it = payload ? pending.find((char)frame[0]) : pending.end();
+        if (it != pending.end())
+        {
+            expire(it->second);
+        }
+        if (it == pending.end() || it->second.empty() || !it->second.front().request)
+        {
+            if (it != pending.end() && !it->second.empty())
+            {
+                // late response to a request that gave up
+                it->second.pop_front();
+            }
+            if (notify) notify(frame, payload);
+            return;
+        }
+
+        RequestAwaiter * request = it->second.front().request;
+        Response & r = request->result;
+        r.packet_type = (char)frame[0];
+        r.resp_status = payload > 1 ? (char)frame[1] : 0;
+
+        // get_resp_*() split the text in place, each needs a fresh copy
+        std::vector<char> text(payload + 1), field(payload + 1);
+        auto copy = [&]() { memcpy(text.data(), frame, payload); text[payload] = 0; return text.data(); };
+        if (framer.get_resp_path(copy(), payload, field.data())) r.path = field.data();
+        if (framer.get_resp_timestamp(copy(), payload, field.data())) r.timestamp = field.data();
+        if (framer.get_resp_data(copy(), payload, field.data())) r.data = field.data();
+
+        complete(request, Status::Ok);
+    }
+
+    /* '?' carries nothing to match on, it answers the oldest request sent */
+    void onReject(const uint8_t * frame, uint16_t payload)
+    {
+        std::list<detail::PendingEntry> * oldest = nullptr;
+        for (auto & queue : pending)
+        {
+            expire(queue.second);
+            if (!queue.second.empty() && (!oldest || queue.second.front().sequence < oldest->front().sequence))
+            {
+                oldest = &queue.second;
+            }
+        }
+        if (!oldest)
+        {
+            if (notify) notify(frame, payload);
+            return;
+        }
+
+        RequestAwaiter * request = oldest->front().request;
+        if (!request)
+        {
+            oldest->pop_front();
+            if (notify) notify(frame, payload);
+            return;
+        }
+        request->result.packet_type = (char)frame[0];
+        request->result.resp_status = payload > 1 ? (char)frame[1] : 0;
+        complete(request, Status::Rejected);
+    }
+
+    /* Placeholders only wait so long, a response that never comes must */
+    /* not take the next request's answer */
+    void expire(std::list<detail::PendingEntry> & queue)
+    {
+        EventLoop::Clock::time_point now = EventLoop::Clock::now();
+        while (!queue.empty() && !queue.front().request && queue.front().expires <= now)
+        {
+            queue.pop_front();
+        }
+    }
+
+    void enqueue(RequestAwaiter * request)
+    {
+        char response_type = (char)tolower((unsigned char)request->frame[0]);
+        auto & queue = pending[response_type];
+        request->position = queue.insert(queue.end(), detail::PendingEntry{ request, next_sequence++, {} });
+        pending_count++;
+        send(request->frame);
+    }
+
+    /* Timeout and cancel keep the slot, the response may still be on its way */
+    void abandon(RequestAwaiter * request, Status status)
+    {
+        if (fd >= 0)
+        {
+            request->position->request = nullptr;
+            request->position->expires = EventLoop::Clock::now() + request->timeout;
+        }
+        complete(request, status);
+    }
+
+    void complete(RequestAwaiter * request, Status status)
+    {
+        char response_type = (char)tolower((unsigned char)request->frame[0]);
+        if (request->position->request)
+        {
+            pending[response_type].erase(request->position);
+        }
+        pending_count--;
+        if (request->timer_armed)
+        {
+            loop.cancelTimer(request->timer);
+        }
+        if (request->token.valid() && !request->token.cancelled())
+        {
+            request->token.remove(request->cancel_entry);
+        }
+        request->result.status = status;
+        loop.post(request->waiter);
+    }
+
+    EventLoop & loop;
+    int fd;
+    ArduhdlcSw framer;
+    std::vector<uint8_t> out;
+    std::map<char, std::list<detail::PendingEntry>> pending;
+    size_t pending_count = 0;
+    uint64_t next_sequence = 0;
+    NotifyHandler notify;
+};
+
+inline bool RequestAwaiter::await_ready()
+{
+    if (token.cancelled())
+    {
+        result.status = Status::Cancelled;
+        return true;
+    }
+    if (link->fd < 0 || frame.empty())
+    {
+        result.status = Status::Closed;
+        return true;
+    }
+    return false;
+}
+
+inline void RequestAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+    waiter = h;
+    timer = link->loop.addTimer(timeout, [this] { timer_armed = false; link->abandon(this, Status::Timeout); });
+    timer_armed = true;
+    if (token.valid())
+    {
+        cancel_entry = token.onCancel([this] { link->abandon(this, Status::Cancelled); });
+    }
+    link->enqueue(this);
+}
+
+} // namespace arduhdlc
+
+#endif // !ARDUINO && C++20
+
+#endif
@@ -0,0 +1,279 @@
+/*
+HdlcCapture, append-only log of received HDLC traffic
+HdlcReplay, host side player for those logs
+*/
+
+#include "HdlcCapture.h"
+
+#ifndef ARDUINO
+#include <chrono>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* little endian field writers, the log looks the same from AVR and host */
+static void put16(uint8_t *out, uint16_t value)
+{
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+}
+
+static void put32(uint8_t *out, uint32_t value)
+{
+    put16(out, value & 0xFFFF);
+    put16(out + 2, value >> 16);
+}
+
+static uint16_t get16(const uint8_t *in)
+{
+    return in[0] | ((uint16_t)in[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *in)
+{
+    return get16(in) | ((uint32_t)get16(in + 2) << 16);
+}
+
+HdlcCapture::HdlcCapture (capture_write_type write,
+                          clock_type clock,
+                          uint32_t clock_hz) : write_function(write), clock(clock), clock_hz(clock_hz)
+{
+    this->raw_length = 0;
+    this->raw_time = 0;
+    this->raw_gap = (clock_hz >= 1000) ? (clock_hz / 1000) * HDLC_CAPTURE_RAW_GAP_MS : HDLC_CAPTURE_RAW_GAP_MS;
+    this->record_count = 0;
+}
+
+void HdlcCapture::begin(void)
+{
+    uint8_t header[HDLC_CAPTURE_HEADER_SIZE];
+
+    memcpy(header, HDLC_CAPTURE_MAGIC, 8);
+    put16(header + 8, HDLC_CAPTURE_VERSION);
+    put16(header + 10, HDLC_CAPTURE_HEADER_SIZE);
+    put32(header + 12, this->clock_hz);
+    (*this->write_function)(header, sizeof(header));
+}
+
+void HdlcCapture::record(uint32_t time, uint8_t kind, uint8_t flags, const uint8_t *payload, uint16_t length)
+{
+    static const uint8_t padding[3] = { 0, 0, 0 };
+    uint8_t header[HDLC_CAPTURE_RECORD_SIZE];
+
+    put32(header, time);
+    header[4] = kind;
+    header[5] = flags;
+    put16(header + 6, length);
+
+    (*this->write_function)(header, sizeof(header));
+    (*this->write_function)(payload, length);
+    if (length & 3)
+    {
+        (*this->write_function)(padding, 4 - (length & 3));
+    }
+    this->record_count++;
+}
+
+void HdlcCapture::flush(void)
+{
+    if (this->raw_length)
+    {
+        this->record(this->raw_time, HDLC_CAPTURE_RAW, 0, this->raw, this->raw_length);
+        this->raw_length = 0;
+    }
+}
+
+void HdlcCapture::rawByte(uint8_t data)
+{
+    uint32_t now = this->clock ? (*this->clock)() : 0;
+
+    // every byte of a record shares its time, so bytes after a gap start a new one
+    if (this->raw_length && ((uint32_t)(now - this->raw_time) >= this->raw_gap))
+    {
+        this->flush();
+    }
+    if (0 == this->raw_length)
+    {
+        this->raw_time = now;
+    }
+    this->raw[this->raw_length++] = data;
+    if (HDLC_CAPTURE_RAW_CHUNK == this->raw_length)
+    {
+        this->flush();
+    }
+}
+
+/* Raw bytes up to and including the closing flag go first, so replay */
+/* order matches what the decoder saw */
+void HdlcCapture::frame(const uint8_t *framebuffer, uint16_t framelength, uint8_t flags)
+{
+    this->flush();
+    this->record(this->clock ? (*this->clock)() : 0, HDLC_CAPTURE_FRAME, flags, framebuffer, framelength);
+}
+
+uint32_t HdlcCapture::records(void)
+{
+    return this->record_count;
+}
+
+#ifndef ARDUINO
+
+HdlcReplay::HdlcReplay ()
+{
+    this->map = NULL;
+    this->map_length = 0;
+    this->position = 0;
+    this->clock_hz = 0;
+}
+
+HdlcReplay::~HdlcReplay ()
+{
+    this->close();
+}
+
+bool HdlcReplay::open(const char *path)
+{
+    struct stat info;
+
+    this->close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    if ((fstat(fd, &info) < 0) || (info.st_size < HDLC_CAPTURE_HEADER_SIZE))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void *mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (MAP_FAILED == mapped)
+    {
+        return false;
+    }
+    this->map = (const uint8_t *)mapped;
+    this->map_length = info.st_size;
+
+    if ((0 != memcmp(this->map, HDLC_CAPTURE_MAGIC, 8))
+        || (HDLC_CAPTURE_VERSION != get16(this->map + 8))
+        || (get16(this->map + 10) < HDLC_CAPTURE_HEADER_SIZE))
+    {
+        this->close();
+        return false;
+    }
+    this->clock_hz = get32(this->map + 12);
+    madvise((void *)this->map, this->map_length, MADV_SEQUENTIAL);
+    this->rewind();
+    return true;
+}
+
+void HdlcReplay::close(void)
+{
+    if (this->map)
+    {
+        munmap((void *)this->map, this->map_length);
+    }
+    this->map = NULL;
+    this->map_length = 0;
+    this->position = 0;
+}
+
+void HdlcReplay::rewind(void)
+{
+    this->position = this->map ? get16(this->map + 10) : 0;
+}
+
+bool HdlcReplay::next(hdlc_capture_record_t *record)
+{
+    if ((NULL == this->map) || (this->position + HDLC_CAPTURE_RECORD_SIZE > this->map_length))
+    {
+        return false;
+    }
+    const uint8_t *header = this->map + this->position;
+    uint16_t length = get16(header + 6);
+    size_t padded = (length + 3) & ~(size_t)3;
+
+    // a capture cut off mid-record ends here
+    if (this->position + HDLC_CAPTURE_RECORD_SIZE + length > this->map_length)
+    {
+        return false;
+    }
+    record->time = get32(header);
+    record->kind = header[4];
+    record->flags = header[5];
+    record->length = length;
+    record->payload = header + HDLC_CAPTURE_RECORD_SIZE;
+    this->position += HDLC_CAPTURE_RECORD_SIZE + padded;
+    return true;
+}
+
+uint32_t HdlcReplay::clockHz(void)
+{
+    return this->clock_hz;
+}
+
+hdlc_replay_stats_t HdlcReplay::run(ArduhdlcSw &hdlc, bool realtime)
+{
+    typedef std::chrono::steady_clock replay_clock;
+
+    hdlc_replay_stats_t stats;
+    hdlc_capture_record_t record;
+    bool first = true;
+    uint32_t last_time = 0;
+    uint64_t elapsed = 0;           // capture clock ticks since the first record
+
+    memset(&stats, 0, sizeof(stats));
+    this->rewind();
+    replay_clock::time_point start = replay_clock::now();
+
+    while (this->next(&record))
+    {
+        stats.records++;
+
+        // consecutive records are less than a wrap apart, so summing the
+        // unsigned steps keeps counting past the capture clock wrapping
+        if (first)
+        {
+            last_time = record.time;
+            first = false;
+        }
+        elapsed += (uint32_t)(record.time - last_time);
+        last_time = record.time;
+
+        if (HDLC_CAPTURE_FRAME == record.kind)
+        {
+            stats.frames_captured++;
+            if (record.flags & HDLC_CAPTURE_FLAG_BAD_FCS)
+            {
+                stats.bad_fcs_captured++;
+            }
+            continue;
+        }
+        if (HDLC_CAPTURE_RAW != record.kind)
+        {
+            continue;
+        }
+
+        if (realtime && this->clock_hz)
+        {
+            double offset = (double)elapsed / this->clock_hz;
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<replay_clock::duration>(std::chrono::duration<double>(offset)));
+        }
+
+        for (uint16_t i = 0; i < record.length; i++)
+        {
+            hdlc.charReceiver(record.payload[i]);
+        }
+        stats.raw_bytes += record.length;
+    }
+
+    stats.elapsed_s = std::chrono::duration<double>(replay_clock::now() - start).count();
+    return stats;
+}
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef hdlcCapture_h
+#define hdlcCapture_h
+
+#include "ArduhdlcSw.h"
+
+/*
+Traffic capture for charReceiver() and offline replay.
+
+Log format, all fields little endian, append only:
+
+    file header   magic[8] "HDLCCAP1"  version[2]  header_size[2]  clock_hz[4]
+    record        time[4]  kind[1]  flags[1]  length[2]  payload[length]  pad to 4
+
+time is the capture clock (micros() by default) when the record was started,
+it wraps and replay adds up the differences between records. Raw records hold the bytes as
+received, frame records the decoded frame including its FCS. Records are
+4-byte aligned so a mapped log can be walked in place.
+*/
+
+#define HDLC_CAPTURE_MAGIC          "HDLCCAP1"
+#define HDLC_CAPTURE_VERSION        1
+#define HDLC_CAPTURE_HEADER_SIZE    16
+#define HDLC_CAPTURE_RECORD_SIZE    8
+
+// Record kind - byte 4
+#define HDLC_CAPTURE_RAW            'R'
+#define HDLC_CAPTURE_FRAME          'F'
+
+// Record flags - byte 5
+#define HDLC_CAPTURE_FLAG_BAD_FCS   0x01
+
+// Raw bytes buffered before a record is written, sizes the class, so only
+// change it here or with a -D build flag that reaches HdlcCapture.cpp too
+#ifndef HDLC_CAPTURE_RAW_CHUNK
+#define HDLC_CAPTURE_RAW_CHUNK      32
+#endif
+
+// A raw record covers at most this long, later bytes start a new one so
+// they are not stamped with the time of bytes before an idle gap
+#ifndef HDLC_CAPTURE_RAW_GAP_MS
+#define HDLC_CAPTURE_RAW_GAP_MS     10
+#endif
+
+typedef void (* capture_write_type)(const uint8_t *data, uint16_t length);
+
+typedef struct
+{
+    uint32_t time;
+    uint8_t  kind;
+    uint8_t  flags;
+    uint16_t length;
+    const uint8_t * payload;
+} hdlc_capture_record_t;
+
+class HdlcCapture
+{
+  public:
+    /* write gets the log byte stream, clock stamps records, */
+    /* clock_hz is stored in the header for replay (1000000 for micros) */
+    HdlcCapture (capture_write_type write, clock_type clock, uint32_t clock_hz);
+
+    /* Write the file header, once at the start of a new log */
+    void begin(void);
+    /* Write out buffered raw bytes */
+    void flush(void);
+
+    // called by ArduhdlcSw, virtual so sketches without capture need not link it
+    virtual void rawByte(uint8_t data);
+    virtual void frame(const uint8_t *framebuffer, uint16_t framelength, uint8_t flags);
+
+    uint32_t records(void);
+
+  private:
+    capture_write_type write_function;
+    clock_type clock;
+    uint32_t clock_hz;
+
+    uint8_t raw[HDLC_CAPTURE_RAW_CHUNK];
+    uint8_t raw_length;
+    uint32_t raw_time;
+    uint32_t raw_gap;               // HDLC_CAPTURE_RAW_GAP_MS in clock ticks
+    uint32_t record_count;
+
+    void record(uint32_t time, uint8_t kind, uint8_t flags, const uint8_t *payload, uint16_t length);
+};
+
+#ifndef ARDUINO
+
+typedef struct
+{
+    uint32_t records;
+    uint32_t raw_bytes;
+    uint32_t frames_captured;       // frame records in the log
+    uint32_t bad_fcs_captured;
+    double   elapsed_s;             // wall time of the replay
+} hdlc_replay_stats_t;
+
+/* Host only: maps a capture log and feeds it back through a decoder */
+class HdlcReplay
+{
+  public:
+    HdlcReplay ();
+    ~HdlcReplay ();
+
+    bool open(const char *path);
+    void close(void);
+
+    /* Walk records in place, false at the end or on a truncated record */
+    void rewind(void);
+    bool next(hdlc_capture_record_t *record);
+
+    /* Feed raw records to charReceiver(), realtime keeps the captured gaps */
+    hdlc_replay_stats_t run(ArduhdlcSw &hdlc, bool realtime);
+
+    uint32_t clockHz(void);
+
+  private:
+    const uint8_t * map;
+    size_t map_length;
+    size_t position;
+    uint32_t clock_hz;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,276 @@
+/*
+HdlcMux, channel byte multiplexing with credit flow control
+*/
+
+#include "HdlcMux.h"
+
+HdlcMux::HdlcMux (ArduhdlcSw &hdlc, clock_type clock) : hdlc(hdlc), clock(clock)
+{
+    memset(this->channels, 0, sizeof(this->channels));
+    this->next_channel = 1;
+}
+
+uint32_t HdlcMux::now(void)
+{
+    return this->clock ? (uint32_t)(*this->clock)() : 0;
+}
+
+// frames sent that the peer has not reported done with
+uint8_t HdlcMux::outstanding(mux_channel_t *ch)
+{
+    return (uint8_t)(ch->sent - ch->peer_consumed);
+}
+
+/* Sequence numbers survive a close, so the peer's counts stay valid */
+bool HdlcMux::openChannel(uint8_t channel, frame_handler_type handler, uint8_t priority)
+{
+    if ((HDLC_MUX_CONTROL_CHANNEL == channel) || (channel >= HDLC_MUX_CHANNELS) || (NULL == handler))
+    {
+        return false;
+    }
+    mux_channel_t *ch = &this->channels[channel];
+    ch->handler = handler;
+    ch->priority = priority;
+    return true;
+}
+
+void HdlcMux::closeChannel(uint8_t channel)
+{
+    if ((HDLC_MUX_CONTROL_CHANNEL == channel) || (channel >= HDLC_MUX_CHANNELS))
+    {
+        return;
+    }
+    mux_channel_t *ch = &this->channels[channel];
+    // frames still buffered are dropped, the peer gets their credits back
+    ch->stats.dropped += ch->rx_count;
+    ch->rx_count = 0;
+    ch->handler = NULL;
+    this->report_credits(channel);
+}
+
+bool HdlcMux::send(uint8_t channel, const char *framebuffer, uint8_t frame_length)
+{
+    char frame[HDLC_TX_QUEUE_FRAME_LENGTH];
+
+    if ((HDLC_MUX_CONTROL_CHANNEL == channel) || (channel >= HDLC_MUX_CHANNELS))
+    {
+        return false;
+    }
+    mux_channel_t *ch = &this->channels[channel];
+
+    if ((this->outstanding(ch) >= HDLC_MUX_RX_SLOTS) || (frame_length > HDLC_MUX_FRAME_LENGTH)
+            || (frame_length + HDLC_MUX_HEADER_LENGTH > HDLC_TX_QUEUE_FRAME_LENGTH))
+    {
+        ch->stats.blocked++;
+        return false;
+    }
+
+    frame[0] = (char)(ch->started ? channel : (channel | HDLC_MUX_FLAG_START));
+    frame[1] = (char)(ch->sent + 1);
+    memcpy(frame + HDLC_MUX_HEADER_LENGTH, framebuffer, frame_length);
+    if (!this->hdlc.queueFrame(frame, frame_length + HDLC_MUX_HEADER_LENGTH, ch->priority))
+    {
+        ch->stats.blocked++;
+        return false;
+    }
+    // the stall timeout runs from the first frame in flight
+    if (0 == this->outstanding(ch))
+    {
+        ch->progress_time = this->now();
+    }
+    ch->sent++;
+    ch->stats.sent++;
+    return true;
+}
+
+uint8_t HdlcMux::credits(uint8_t channel)
+{
+    if ((HDLC_MUX_CONTROL_CHANNEL == channel) || (channel >= HDLC_MUX_CHANNELS))
+    {
+        return 0;
+    }
+    uint8_t in_flight = this->outstanding(&this->channels[channel]);
+    return (in_flight < HDLC_MUX_RX_SLOTS) ? HDLC_MUX_RX_SLOTS - in_flight : 0;
+}
+
+void HdlcMux::handleFrame(const uint8_t *framebuffer, uint16_t framelength)
+{
+    // drop the FCS, a frame needs at least channel and seq
+    if (framelength < HDLC_MUX_HEADER_LENGTH + 2)
+    {
+        return;
+    }
+    framelength -= 2;
+
+    uint8_t channel = framebuffer[0] & ~HDLC_MUX_FLAG_START;
+    bool start = (0 != (framebuffer[0] & HDLC_MUX_FLAG_START));
+
+    if (HDLC_MUX_CONTROL_CHANNEL == channel)
+    {
+        if ((4 != framelength) || (HDLC_MUX_CONTROL_CHANNEL == framebuffer[2]) || (framebuffer[2] >= HDLC_MUX_CHANNELS))
+        {
+            return;
+        }
+        mux_channel_t *ch = &this->channels[framebuffer[2]];
+        uint8_t count = framebuffer[3];
+
+        if (HDLC_MUX_CREDIT == framebuffer[1])
+        {
+            if ((uint8_t)(count - ch->peer_consumed) <= this->outstanding(ch))
+            {
+                if (count != ch->peer_consumed)
+                {
+                    ch->peer_consumed = count;
+                    ch->progress_time = this->now();
+                    ch->started = true;
+                }
+            }
+            else
+            {
+                // not between what the peer had and what we sent: the peer
+                // restarted, frames in flight are gone, start from its count
+                ch->sent = count;
+                ch->peer_consumed = count;
+                ch->progress_time = this->now();
+            }
+        }
+        else if (HDLC_MUX_SYNC == framebuffer[1])
+        {
+            // frames the sender has sent and we never saw are lost
+            uint8_t missing = (uint8_t)(count - ch->received);
+            if ((0 != missing) && (missing <= HDLC_MUX_RX_SLOTS))
+            {
+                ch->stats.lost += missing;
+                ch->received = count;
+            }
+            // the sender is stalled, our last report may have been lost
+            ch->report_now = true;
+        }
+        return;
+    }
+    if (channel >= HDLC_MUX_CHANNELS)
+    {
+        return;
+    }
+
+    mux_channel_t *ch = &this->channels[channel];
+    uint8_t seq = framebuffer[1];
+    const uint8_t *payload = framebuffer + HDLC_MUX_HEADER_LENGTH;
+    uint16_t payload_length = framelength - HDLC_MUX_HEADER_LENGTH;
+
+    bool seen = ch->receiving && ((uint8_t)(ch->received - seq) < HDLC_MUX_RX_SLOTS);
+    uint8_t step = (uint8_t)(seq - ch->received);
+    if (seen && !start)
+    {
+        // already seen or written off, its credit is accounted for
+        ch->stats.dropped++;
+        return;
+    }
+    if (seen || !ch->receiving || (step > HDLC_MUX_RX_SLOTS))
+    {
+        // the peer restarted its sequence, follow it; frames still buffered
+        // are from before and would throw off the done count it gets
+        ch->stats.dropped += ch->rx_count;
+        ch->rx_count = 0;
+        step = 1;
+    }
+    ch->stats.lost += step - 1;
+    ch->received = seq;
+    ch->receiving = true;
+
+    // a dropped frame counts as done at once, received - rx_count covers it
+    if ((NULL == ch->handler) || (HDLC_MUX_RX_SLOTS == ch->rx_count) || (payload_length > HDLC_MUX_FRAME_LENGTH))
+    {
+        ch->stats.dropped++;
+        return;
+    }
+
+    uint8_t slot = (ch->rx_head + ch->rx_count) % HDLC_MUX_RX_SLOTS;
+    memcpy(ch->rx_frame[slot], payload, payload_length);
+    ch->rx_length[slot] = payload_length;
+    ch->rx_count++;
+    ch->stats.received++;
+}
+
+void HdlcMux::poll(void)
+{
+    for (uint8_t i = 1; i < HDLC_MUX_CHANNELS; i++)
+    {
+        uint8_t channel = this->next_channel;
+        this->next_channel = (channel + 1 < HDLC_MUX_CHANNELS) ? channel + 1 : 1;
+
+        mux_channel_t *ch = &this->channels[channel];
+        if (ch->rx_count && ch->handler)
+        {
+            uint8_t slot = ch->rx_head;
+            (*ch->handler)(ch->rx_frame[slot], ch->rx_length[slot]);
+            ch->rx_head = (slot + 1) % HDLC_MUX_RX_SLOTS;
+            ch->rx_count--;
+            ch->stats.delivered++;
+        }
+        this->report_credits(channel);
+        this->sync_sender(channel);
+    }
+}
+
+/* Report how many frames we are done with on the control channel, when it */
+/* changes and every HDLC_MUX_RESYNC_MS. Retried on the next poll if the */
+/* transmit queue is full */
+void HdlcMux::report_credits(uint8_t channel)
+{
+    mux_channel_t *ch = &this->channels[channel];
+    uint8_t done = (uint8_t)(ch->received - ch->rx_count);
+    uint32_t time = this->now();
+
+    bool due = ch->report_now || (done != ch->reported);
+    if (this->clock && (ch->handler || ch->received) && ((uint32_t)(time - ch->report_time) >= HDLC_MUX_RESYNC_MS))
+    {
+        due = true;
+    }
+    if (!due)
+    {
+        return;
+    }
+
+    char frame[4] = { HDLC_MUX_CONTROL_CHANNEL, HDLC_MUX_CREDIT, (char)channel, (char)done };
+    if (this->hdlc.queueFrame(frame, sizeof(frame), HDLC_TX_PRIORITY_CONTROL))
+    {
+        ch->reported = done;
+        ch->report_now = false;
+        ch->report_time = time;
+    }
+}
+
+/* No credit back for HDLC_MUX_RESYNC_MS: tell the peer how far we got, so */
+/* frames it never saw are written off. Only once our frames on this */
+/* channel are all on the wire, or the peer would count them lost */
+void HdlcMux::sync_sender(uint8_t channel)
+{
+    mux_channel_t *ch = &this->channels[channel];
+    uint32_t time = this->now();
+
+    if ((NULL == this->clock) || (0 == this->outstanding(ch))
+            || ((uint32_t)(time - ch->progress_time) < HDLC_MUX_RESYNC_MS))
+    {
+        return;
+    }
+    if (this->hdlc.queuedFrames(ch->priority) || this->hdlc.txBusy())
+    {
+        return;
+    }
+
+    char frame[4] = { HDLC_MUX_CONTROL_CHANNEL, HDLC_MUX_SYNC, (char)channel, (char)ch->sent };
+    if (this->hdlc.queueFrame(frame, sizeof(frame), HDLC_TX_PRIORITY_CONTROL))
+    {
+        ch->progress_time = time;
+    }
+}
+
+const mux_channel_stats_t * HdlcMux::stats(uint8_t channel)
+{
+    if (channel >= HDLC_MUX_CHANNELS)
+    {
+        return NULL;
+    }
+    return &this->channels[channel].stats;
+}
@@ -0,0 +1,137 @@
+#ifndef hdlcMux_h
+#define hdlcMux_h
+
+#include "ArduhdlcSw.h"
+
+/*
+Logical channels over one HDLC link.
+
+Every frame starts with a channel byte, like the HDLC address field, and a
+per channel sequence number:
+
+    channel[1] seq[1] payload[]
+
+Channel 0 is the mux control channel, 1 .. HDLC_MUX_CHANNELS-1 carry user
+frames. Each channel has its own handler and receive slots, and a sender
+may only have as many frames in flight on a channel as the peer has slots
+(credits). A credit comes back once the peer's handler has consumed a
+frame, so a busy channel never takes buffer space from the others.
+Both ends must be built with the same HDLC_MUX_RX_SLOTS.
+
+Credits travel as running counts, not increments: the receiver reports how
+many frames it is done with, delivered, dropped or missing from the
+sequence, and repeats that every HDLC_MUX_RESYNC_MS. A sender whose frames
+got no credit back for that long sends its own count, so a lost last frame
+is written off too. A lost frame or report never costs a credit for good.
+
+A sender sets HDLC_MUX_FLAG_START in the channel byte until the peer has
+reported one of its frames done, so a receiver that already saw that
+sequence number knows the sender restarted rather than repeated. A fresh
+receiver takes up the sequence of the first frame it gets, and a credit
+count that makes no sense is taken as a receiver reset.
+
+Sizes fix the class layout, change them here or with -D build flags, a
+#define in the sketch does not reach HdlcMux.cpp.
+*/
+
+#ifndef HDLC_MUX_CHANNELS
+#define HDLC_MUX_CHANNELS           4     // including control channel 0
+#endif
+
+#ifndef HDLC_MUX_RX_SLOTS
+#define HDLC_MUX_RX_SLOTS           2     // buffered frames per channel, initial credits
+#endif
+
+#ifndef HDLC_MUX_FRAME_LENGTH
+#define HDLC_MUX_FRAME_LENGTH       64    // payload bytes per slot
+#endif
+
+// Credit report period and sender stall timeout, clock ticks (ms with millis)
+#ifndef HDLC_MUX_RESYNC_MS
+#define HDLC_MUX_RESYNC_MS          1000
+#endif
+
+#if HDLC_MUX_CHANNELS > 128
+#error "HDLC_MUX_CHANNELS above 128 collides with HDLC_MUX_FLAG_START"
+#endif
+
+#define HDLC_MUX_CONTROL_CHANNEL    0
+#define HDLC_MUX_FLAG_START         0x80  // channel byte, sender's first frames
+#define HDLC_MUX_HEADER_LENGTH      2     // channel, seq
+
+// Control channel messages - byte 1
+#define HDLC_MUX_CREDIT             'K'   // channel[1]=0 'K' data_channel[1] consumed[1]
+#define HDLC_MUX_SYNC               'S'   // channel[1]=0 'S' data_channel[1] sent[1]
+
+typedef struct
+{
+    uint32_t received;      // frames buffered
+    uint32_t delivered;     // frames passed to the handler
+    uint32_t dropped;       // no free slot or channel closed
+    uint32_t lost;          // never arrived, gaps in the sequence
+    uint32_t sent;
+    uint32_t blocked;       // send() refused, no credit or queue full
+} mux_channel_stats_t;
+
+typedef struct
+{
+    frame_handler_type handler;     // NULL when closed
+    uint8_t  priority;              // transmit queue priority
+
+    // sending side, sequence numbers count modulo 256
+    uint8_t  sent;                  // seq of the last frame sent
+    bool     started;               // peer reported one of our frames done
+    uint8_t  peer_consumed;         // peer's count of frames it is done with
+    uint32_t progress_time;         // when peer_consumed last moved
+
+    // receiving side, frames done with = received - rx_count
+    uint8_t  received;              // seq of the last frame seen
+    bool     receiving;             // a frame arrived, received is the peer's
+    uint8_t  reported;              // done count in the last 'K'
+    bool     report_now;
+    uint32_t report_time;
+
+    uint8_t  rx_head;
+    uint8_t  rx_count;
+    uint8_t  rx_length[HDLC_MUX_RX_SLOTS];
+    uint8_t  rx_frame[HDLC_MUX_RX_SLOTS][HDLC_MUX_FRAME_LENGTH];
+    mux_channel_stats_t stats;
+} mux_channel_t;
+
+class HdlcMux
+{
+  public:
+    /* Frames go through the transmit queue, hdlc needs setTxQueue(). */
+    /* clock drives the credit resync, e.g. millis; NULL turns it off */
+    HdlcMux (ArduhdlcSw &hdlc, clock_type clock);
+
+    /* handler gets the payload without channel, seq and FCS */
+    bool openChannel(uint8_t channel, frame_handler_type handler, uint8_t priority);
+    void closeChannel(uint8_t channel);
+
+    /* false when the peer has no room on this channel, try again later */
+    bool send(uint8_t channel, const char *framebuffer, uint8_t frame_length);
+    uint8_t credits(uint8_t channel);
+
+    /* Pass frames from the ArduhdlcSw frame handler as is, length includes the FCS */
+    void handleFrame(const uint8_t *framebuffer, uint16_t framelength);
+
+    /* Call from loop(): delivers at most one frame per channel, round robin, */
+    /* and reports credits to the peer */
+    void poll(void);
+
+    const mux_channel_stats_t * stats(uint8_t channel);
+
+  private:
+    ArduhdlcSw &hdlc;
+    clock_type clock;
+    mux_channel_t channels[HDLC_MUX_CHANNELS];
+    uint8_t next_channel;
+
+    uint32_t now(void);
+    uint8_t outstanding(mux_channel_t *ch);
+    void report_credits(uint8_t channel);
+    void sync_sender(uint8_t channel);
+};
+
+#endif
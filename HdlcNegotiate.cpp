@@ -0,0 +1,714 @@
+/*
+HdlcNegotiator, capability exchange and baud rate step up
+
+Negotiation frames are sent with frameDecode() rather than the transmit
+queue: every one of them has to be on the wire before a rate change. They
+are built into pending and go out from poll() once the queue is empty and
+no frame is half sent, followed by the rate change if there is one. Probes
+need no rate change after them and use the queue when it can take them.
+*/
+
+#include "HdlcNegotiate.h"
+
+static const uint32_t baud_rates[] = { 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600 };
+
+// escape octets and alternating bits, no ',' since fields are comma separated,
+// repeated to fill the agreed frame length
+static const char probe_pattern[] = "~}~}\x55\xAA\x55\xAA\xFF\x01\x80\x7F" "0123456789abcdefghijklmnopqrstuvwxyz~}";
+
+#define PROBE_PATTERN_LENGTH    (sizeof(probe_pattern) - 1)
+
+/* value of field id in a request, copied to out; false if missing */
+static bool get_field(const char *text, char id, char *out, uint8_t out_size)
+{
+    const char *field = text + 4;
+    while (*field)
+    {
+        const char *end = (SBR_FIELD_ID_DATA == *field) ? NULL : strchr(field, ',');
+        uint8_t length = end ? (uint8_t)(end - field - 1) : (uint8_t)strlen(field + 1);
+        if (*field == id)
+        {
+            if (length >= out_size)
+            {
+                length = out_size - 1;
+            }
+            memcpy(out, field + 1, length);
+            out[length] = 0;
+            return true;
+        }
+        if (NULL == end)
+        {
+            break;
+        }
+        field = end + 1;
+    }
+    return false;
+}
+
+HdlcNegotiator::HdlcNegotiator (ArduhdlcSw &hdlc,
+                                set_baud_type set_baud,
+                                clock_type clock,
+                                uint32_t base_baud) : hdlc(hdlc), set_baud(set_baud), clock(clock)
+{
+    this->base_baud = base_baud;
+    this->local_max_baud = base_baud;
+    this->local_frame_length = HDLC_TX_QUEUE_FRAME_LENGTH;
+    this->local_features[0] = 0;
+
+    this->max_baud = base_baud;
+    this->frame_length = HDLC_TX_QUEUE_FRAME_LENGTH;
+    this->crc_variant = HDLC_NEG_CRC_CCITT_FALSE;
+    this->features[0] = 0;
+
+    this->neg_state = NEG_IDLE;
+    this->initiator = false;
+    this->current_baud = base_baud;
+    this->good_baud = base_baud;
+    this->request_baud = base_baud;
+    this->deadline = 0;
+    this->wait_ms = 0;
+    this->link_timeout = 0;
+    this->last_frame = 0;
+    this->probes_sent = 0;
+    this->probes_direct = false;
+    this->probes_received = 0;
+    this->seq = 0;
+    this->seq_valid = false;
+    this->ack_status = SBR_STATUS_OK;
+    this->retries = 0;
+    this->step_passed = false;
+    this->pending_length = 0;
+    this->switch_pending = false;
+}
+
+void HdlcNegotiator::setLocal(uint16_t max_frame_length, uint32_t max_baud, const char *features)
+{
+    // probes are built in a HDLC_TX_QUEUE_FRAME_LENGTH buffer, FCS not included
+    if (max_frame_length > HDLC_TX_QUEUE_FRAME_LENGTH + 2)
+    {
+        max_frame_length = HDLC_TX_QUEUE_FRAME_LENGTH + 2;
+    }
+    this->local_frame_length = max_frame_length;
+    this->local_max_baud = max_baud;
+    strncpy(this->local_features, features ? features : "", HDLC_NEG_FEATURES_LENGTH - 1);
+    this->local_features[HDLC_NEG_FEATURES_LENGTH - 1] = 0;
+}
+
+void HdlcNegotiator::setLinkTimeout(uint32_t timeout_ms)
+{
+    this->link_timeout = timeout_ms;
+}
+
+uint32_t HdlcNegotiator::now(void)
+{
+    return this->clock ? (*this->clock)() : 0;
+}
+
+// next entry of the rate table above baud, 0 if none
+uint32_t HdlcNegotiator::next_rate(uint32_t baud)
+{
+    for (uint8_t i = 0; i < sizeof(baud_rates) / sizeof(baud_rates[0]); i++)
+    {
+        if (baud_rates[i] > baud)
+        {
+            return baud_rates[i];
+        }
+    }
+    return 0;
+}
+
+bool HdlcNegotiator::negotiating(void)
+{
+    return (NEG_IDLE != this->neg_state) && (NEG_DONE != this->neg_state);
+}
+
+bool HdlcNegotiator::tx_idle(void)
+{
+    if (this->hdlc.txBusy())
+    {
+        return false;
+    }
+    for (uint8_t priority = 0; priority < HDLC_TX_PRIORITY_COUNT; priority++)
+    {
+        if (this->hdlc.queuedFrames(priority))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Send the pending frame, then change rate. False while the link is busy */
+bool HdlcNegotiator::flush(void)
+{
+    if ((0 == this->pending_length) && !this->switch_pending)
+    {
+        return true;
+    }
+    if (!this->tx_idle())
+    {
+        return false;
+    }
+    if (this->pending_length)
+    {
+        this->hdlc.frameDecode(this->pending, this->pending_length);
+        this->pending_length = 0;
+    }
+    if (this->switch_pending)
+    {
+        (*this->set_baud)(this->current_baud);
+        this->switch_pending = false;
+    }
+    this->deadline = this->now() + this->wait_ms;
+    return true;
+}
+
+void HdlcNegotiator::wait_for(uint32_t ms)
+{
+    this->wait_ms = ms;
+    this->deadline = this->now() + ms;
+}
+
+// takes effect in flush(), after the pending frame
+void HdlcNegotiator::switch_to(uint32_t baud)
+{
+    if (baud != this->current_baud)
+    {
+        this->current_baud = baud;
+        this->switch_pending = true;
+    }
+}
+
+// initiator: back to the base rate, begin() once it settled
+void HdlcNegotiator::restart(void)
+{
+    this->switch_to(this->base_baud);
+    this->good_baud = this->base_baud;
+    this->neg_state = NEG_RESTART;
+    this->wait_for(HDLC_NEG_SETTLE_MS);
+}
+
+void HdlcNegotiator::begin(void)
+{
+    this->initiator = true;
+    this->good_baud = this->current_baud;
+    this->last_frame = this->now();
+    this->neg_state = NEG_CAPS_SENT;
+    this->retries = 0;
+    this->send_request();
+}
+
+/* initiator: a new 'A', repeats keep its sequence number */
+void HdlcNegotiator::request(uint32_t baud, negotiate_state_t state)
+{
+    this->seq++;
+    this->request_baud = baud;
+    this->retries = 0;
+    this->neg_state = state;
+    this->send_request();
+}
+
+void HdlcNegotiator::send_request(void)
+{
+    if (NEG_CAPS_SENT == this->neg_state)
+    {
+        this->send_caps(SBR_PKT_RQST_CAPABILITY, '.');
+    }
+    else
+    {
+        this->pending_length = snprintf(this->pending, sizeof(this->pending), "%c.%s%c%lu,%c%u",
+                SBR_PKT_RQST_BAUD_SWITCH, DEFAUT_ENCODE_SEGMENT,
+                SBR_FIELD_ID_BAUD, (unsigned long)this->request_baud,
+                SBR_FIELD_ID_COUNT, this->seq);
+    }
+    this->wait_for(HDLC_NEG_TIMEOUT_MS);
+}
+
+// initiator: try the next rate, or stay on the committed one
+void HdlcNegotiator::step_up(void)
+{
+    uint32_t next = this->next_rate(this->current_baud);
+    if (next && (next <= this->max_baud))
+    {
+        this->request(next, NEG_SWITCH_SENT);
+    }
+    else
+    {
+        this->neg_state = NEG_DONE;
+    }
+}
+
+// initiator: lost probes, go back and commit the last good rate again
+void HdlcNegotiator::probe_failed(void)
+{
+    this->switch_to(this->good_baud);
+    this->step_passed = false;
+    this->neg_state = NEG_SETTLE_BACK;
+    this->wait_for(HDLC_NEG_SETTLE_MS);
+}
+
+// our limits in a request, the agreed values in a response
+void HdlcNegotiator::send_caps(char type, char status)
+{
+    bool request = (SBR_PKT_RQST_CAPABILITY == type);
+    char crc_list[2] = { request ? HDLC_NEG_CRC_CCITT_FALSE : this->crc_variant, 0 };
+
+    int length = snprintf(this->pending,
+            sizeof(this->pending),
+            "%c%c%s%c%u,%c%s,%c%s,%c%lu",
+            type,
+            status,
+            DEFAUT_ENCODE_SEGMENT,
+            SBR_FIELD_ID_LENGTH,
+            request ? this->local_frame_length : this->frame_length,
+            SBR_FIELD_ID_CRC,
+            crc_list,
+            SBR_FIELD_ID_FEATURES,
+            request ? this->local_features : this->features,
+            SBR_FIELD_ID_BAUD,
+            (unsigned long)(request ? this->local_max_baud : this->max_baud));
+    this->pending_length = (length < (int)sizeof(this->pending)) ? length : sizeof(this->pending) - 1;
+}
+
+// 'a' echoes the sequence number, 'l' carries the probe count
+void HdlcNegotiator::send_status(char type, char status)
+{
+    this->pending_length = snprintf(this->pending, sizeof(this->pending), "%c%c%s%c%u",
+            type, status, DEFAUT_ENCODE_SEGMENT, SBR_FIELD_ID_COUNT,
+            (SBR_PKT_RESP_LINK_PROBE == type) ? this->probes_received : this->seq);
+}
+
+// probe frames are exactly the agreed frame length once the FCS is added
+uint8_t HdlcNegotiator::probe_payload(void)
+{
+    if (this->frame_length < 2)
+    {
+        return 0;
+    }
+    if (this->frame_length - 2 > HDLC_TX_QUEUE_FRAME_LENGTH)
+    {
+        return HDLC_TX_QUEUE_FRAME_LENGTH;
+    }
+    return this->frame_length - 2;
+}
+
+// the probe burst on the wire at the current rate, every octet escaped
+uint32_t HdlcNegotiator::burst_time(void)
+{
+    return (uint32_t)HDLC_NEG_PROBE_FRAMES * (2UL * this->frame_length + 2) * 10000UL / this->current_baud;
+}
+
+uint8_t HdlcNegotiator::build_probe(char *frame, uint8_t seq)
+{
+    uint8_t payload = this->probe_payload();
+    uint8_t length = snprintf(frame, HDLC_TX_QUEUE_FRAME_LENGTH, "%c.%s%c%u,%c",
+            SBR_PKT_RQST_LINK_PROBE, DEFAUT_ENCODE_SEGMENT, SBR_FIELD_ID_COUNT, seq, SBR_FIELD_ID_DATA);
+    for (uint8_t i = 0; length < payload; i++)
+    {
+        frame[length++] = probe_pattern[i % PROBE_PATTERN_LENGTH];
+    }
+    return length;
+}
+
+/* Queue what fits, or send one probe with frameDecode() if there is no */
+/* queue for frames this long. Then wait for the burst to drain */
+void HdlcNegotiator::send_probes(void)
+{
+    char frame[HDLC_TX_QUEUE_FRAME_LENGTH];
+
+    while (this->probes_sent < HDLC_NEG_PROBE_FRAMES)
+    {
+        uint8_t length = this->build_probe(frame, this->probes_sent);
+        if (this->probes_direct || !this->hdlc.queueFrame(frame, length, HDLC_TX_PRIORITY_NORMAL))
+        {
+            if (!this->probes_direct && this->hdlc.queuedFrames(HDLC_TX_PRIORITY_NORMAL))
+            {
+                return;     // queue full, more room on the next poll()
+            }
+            // refused while empty: no queue, or its frames are too short
+            this->probes_direct = true;
+            this->hdlc.frameDecode(frame, length);
+            this->probes_sent++;
+            return;
+        }
+        this->probes_sent++;
+    }
+    if (this->tx_idle())
+    {
+        // host side output may still hold the whole burst
+        this->neg_state = NEG_PROBE_SENT;
+        this->wait_for(HDLC_NEG_TIMEOUT_MS + this->burst_time());
+    }
+}
+
+bool HdlcNegotiator::handleFrame(const uint8_t *framebuffer, uint16_t framelength)
+{
+    char text[HDLC_TX_QUEUE_FRAME_LENGTH + 1];
+    char value[HDLC_TX_QUEUE_FRAME_LENGTH];
+
+    this->last_frame = this->now();
+
+    // drop the FCS
+    if ((framelength < 6) || (framelength - 2 > HDLC_TX_QUEUE_FRAME_LENGTH))
+    {
+        return false;
+    }
+    framelength -= 2;
+    memcpy(text, framebuffer, framelength);
+    text[framelength] = 0;
+
+    char status = text[1];
+
+    switch (text[0])
+    {
+        case SBR_PKT_RQST_CAPABILITY:
+        {
+            // responder: the lower limit of both ends wins
+            this->initiator = false;
+            this->seq_valid = false;
+            this->frame_length = this->local_frame_length;
+            this->max_baud = this->local_max_baud;
+            if (get_field(text, SBR_FIELD_ID_LENGTH, value, sizeof(value)) && ((uint16_t)atoi(value) < this->frame_length))
+            {
+                this->frame_length = atoi(value);
+            }
+            if (get_field(text, SBR_FIELD_ID_BAUD, value, sizeof(value)) && (strtoul(value, NULL, 10) < this->max_baud))
+            {
+                this->max_baud = strtoul(value, NULL, 10);
+            }
+            this->crc_variant = HDLC_NEG_CRC_CCITT_FALSE;
+            this->features[0] = 0;
+            if (get_field(text, SBR_FIELD_ID_FEATURES, value, sizeof(value)))
+            {
+                uint8_t n = 0;
+                for (const char *f = this->local_features; *f; f++)
+                {
+                    if (strchr(value, *f))
+                    {
+                        this->features[n++] = *f;
+                    }
+                }
+                this->features[n] = 0;
+            }
+            bool crc_ok = get_field(text, SBR_FIELD_ID_CRC, value, sizeof(value)) && strchr(value, HDLC_NEG_CRC_CCITT_FALSE);
+
+            this->good_baud = this->current_baud;
+            this->send_caps(SBR_PKT_RESP_CAPABILITY, crc_ok ? SBR_STATUS_OK : SBR_STATUS_BAD_REQUEST);
+            this->neg_state = crc_ok ? NEG_WAIT_SWITCH : NEG_DONE;
+            this->wait_for((HDLC_NEG_RETRIES + 1) * HDLC_NEG_TIMEOUT_MS);
+            return true;
+        }
+
+        case SBR_PKT_RESP_CAPABILITY:
+            if (NEG_CAPS_SENT != this->neg_state)
+            {
+                return true;
+            }
+            if (SBR_STATUS_OK != status)
+            {
+                this->neg_state = NEG_DONE;
+                return true;
+            }
+            if (get_field(text, SBR_FIELD_ID_LENGTH, value, sizeof(value)) && ((uint16_t)atoi(value) < this->local_frame_length))
+            {
+                this->frame_length = atoi(value);
+            }
+            else
+            {
+                this->frame_length = this->local_frame_length;
+            }
+            if (get_field(text, SBR_FIELD_ID_BAUD, value, sizeof(value)))
+            {
+                this->max_baud = strtoul(value, NULL, 10);
+            }
+            if (get_field(text, SBR_FIELD_ID_CRC, value, sizeof(value)))
+            {
+                this->crc_variant = value[0];
+            }
+            if (get_field(text, SBR_FIELD_ID_FEATURES, value, sizeof(value)))
+            {
+                strncpy(this->features, value, HDLC_NEG_FEATURES_LENGTH - 1);
+                this->features[HDLC_NEG_FEATURES_LENGTH - 1] = 0;
+            }
+            this->step_up();
+            return true;
+
+        case SBR_PKT_RQST_BAUD_SWITCH:
+        {
+            if (this->initiator || !get_field(text, SBR_FIELD_ID_BAUD, value, sizeof(value)))
+            {
+                return true;
+            }
+            uint32_t baud = strtoul(value, NULL, 10);
+            uint8_t seq = get_field(text, SBR_FIELD_ID_COUNT, value, sizeof(value)) ? atoi(value) : 0;
+
+            // a repeat means our 'a' got lost, answer again but act only once
+            if (this->seq_valid && (seq == this->seq))
+            {
+                this->send_status(SBR_PKT_RESP_BAUD_SWITCH, this->ack_status);
+                return true;
+            }
+            this->seq = seq;
+            this->seq_valid = true;
+
+            if (baud == this->current_baud)
+            {
+                // commit, both ends fall back to this rate from now on
+                this->good_baud = this->current_baud;
+                this->ack_status = SBR_STATUS_OK;
+                this->neg_state = NEG_WAIT_SWITCH;
+                this->wait_for((HDLC_NEG_RETRIES + 1) * HDLC_NEG_TIMEOUT_MS);
+            }
+            else if ((baud > this->max_baud) || (baud != this->next_rate(this->current_baud)))
+            {
+                this->ack_status = SBR_STATUS_BAD_REQUEST;
+                this->neg_state = NEG_DONE;
+            }
+            else
+            {
+                this->ack_status = SBR_STATUS_OK;
+                this->switch_to(baud);
+                this->probes_received = 0;
+                this->neg_state = NEG_WAIT_PROBE;
+                this->wait_for(HDLC_NEG_TIMEOUT_MS + this->burst_time());
+            }
+            this->send_status(SBR_PKT_RESP_BAUD_SWITCH, this->ack_status);
+            return true;
+        }
+
+        case SBR_PKT_RESP_BAUD_SWITCH:
+            // answers to earlier tries are stale
+            if (!get_field(text, SBR_FIELD_ID_COUNT, value, sizeof(value)) || ((uint8_t)atoi(value) != this->seq))
+            {
+                return true;
+            }
+            if (NEG_COMMIT_SENT == this->neg_state)
+            {
+                this->good_baud = this->current_baud;
+                if (this->step_passed)
+                {
+                    this->step_up();
+                }
+                else
+                {
+                    this->neg_state = NEG_DONE;
+                }
+            }
+            else if (NEG_SWITCH_SENT == this->neg_state)
+            {
+                if (SBR_STATUS_OK != status)
+                {
+                    this->neg_state = NEG_DONE;
+                    return true;
+                }
+                this->switch_to(this->request_baud);
+                this->neg_state = NEG_SETTLE;
+                this->wait_for(HDLC_NEG_SETTLE_MS);
+            }
+            return true;
+
+        case SBR_PKT_RQST_LINK_PROBE:
+        {
+            if (NEG_WAIT_PROBE != this->neg_state)
+            {
+                return true;
+            }
+            char *data = strchr(text, ',');
+            if (data && (SBR_FIELD_ID_DATA == data[1]))
+            {
+                uint8_t header = data + 2 - text;
+                uint8_t payload = this->probe_payload();
+                bool intact = (framelength == ((payload > header) ? payload : header));
+                for (uint8_t i = 0; intact && (header + i < framelength); i++)
+                {
+                    intact = (probe_pattern[i % PROBE_PATTERN_LENGTH] == data[2 + i]);
+                }
+                if (intact)
+                {
+                    this->probes_received++;
+                }
+            }
+            if (!get_field(text, SBR_FIELD_ID_COUNT, value, sizeof(value)) || (atoi(value) != HDLC_NEG_PROBE_FRAMES - 1))
+            {
+                return true;
+            }
+
+            // last probe: report, keep the rate until the commit only if all arrived
+            this->send_status(SBR_PKT_RESP_LINK_PROBE, SBR_STATUS_OK);
+            if (HDLC_NEG_PROBE_FRAMES == this->probes_received)
+            {
+                this->neg_state = NEG_WAIT_COMMIT;
+                this->wait_for((HDLC_NEG_RETRIES + 1) * HDLC_NEG_TIMEOUT_MS);
+            }
+            else
+            {
+                this->switch_to(this->good_baud);
+                this->neg_state = NEG_WAIT_SWITCH;
+                this->wait_for((HDLC_NEG_RETRIES + 1) * HDLC_NEG_TIMEOUT_MS);
+            }
+            return true;
+        }
+
+        case SBR_PKT_RESP_LINK_PROBE:
+            // the reply can beat poll() to noticing the burst has drained
+            if ((NEG_PROBE_SENT != this->neg_state)
+                && ((NEG_PROBING != this->neg_state) || (this->probes_sent < HDLC_NEG_PROBE_FRAMES)))
+            {
+                return true;
+            }
+            if (!get_field(text, SBR_FIELD_ID_COUNT, value, sizeof(value)) || (atoi(value) != HDLC_NEG_PROBE_FRAMES))
+            {
+                this->probe_failed();
+                return true;
+            }
+            this->step_passed = true;
+            this->request(this->current_baud, NEG_COMMIT_SENT);
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+void HdlcNegotiator::poll(void)
+{
+    // replies and rate changes wait for the link to go idle
+    if (!this->flush())
+    {
+        return;
+    }
+
+    uint32_t time = this->now();
+    uint32_t timeout = this->link_timeout;
+
+    // always on while negotiating, a lost frame must not strand the ends
+    if (this->negotiating() && ((0 == timeout) || (timeout > HDLC_NEG_LINK_TIMEOUT_MS)))
+    {
+        timeout = HDLC_NEG_LINK_TIMEOUT_MS;
+    }
+    if (timeout && (this->current_baud != this->base_baud)
+        && ((uint32_t)(time - this->last_frame) > timeout))
+    {
+        // peer gone quiet on a fast rate, meet again at the base rate
+        this->last_frame = time;
+        if (this->initiator)
+        {
+            this->restart();
+        }
+        else
+        {
+            this->switch_to(this->base_baud);
+            this->good_baud = this->base_baud;
+            this->neg_state = NEG_IDLE;
+        }
+        return;
+    }
+
+    if ((int32_t)(time - this->deadline) < 0)
+    {
+        return;
+    }
+
+    switch (this->neg_state)
+    {
+        case NEG_SETTLE:
+            if (!this->tx_idle())
+            {
+                break;
+            }
+            this->probes_sent = 0;
+            this->probes_direct = false;
+            this->neg_state = NEG_PROBING;
+            // fall through
+
+        case NEG_PROBING:
+            this->send_probes();
+            break;
+
+        case NEG_SETTLE_BACK:
+            this->request(this->current_baud, NEG_COMMIT_SENT);
+            break;
+
+        case NEG_RESTART:
+            this->begin();
+            break;
+
+        case NEG_CAPS_SENT:
+        case NEG_SWITCH_SENT:
+        case NEG_COMMIT_SENT:
+        {
+            // a commit after lost probes has to outlast the responder's wait for the commit
+            uint8_t limit = ((NEG_COMMIT_SENT == this->neg_state) && !this->step_passed) ? 2 * HDLC_NEG_RETRIES : HDLC_NEG_RETRIES;
+            if (this->retries < limit)
+            {
+                this->retries++;
+                this->send_request();
+            }
+            else if ((NEG_COMMIT_SENT == this->neg_state) && this->step_passed)
+            {
+                // the responder most likely never got it and went back, follow it
+                this->probe_failed();
+            }
+            else if (NEG_COMMIT_SENT == this->neg_state)
+            {
+                // the peer may or may not have taken it, only the base rate is certain
+                this->restart();
+            }
+            else
+            {
+                // a responder that switched anyway times out back to the committed rate
+                this->neg_state = NEG_DONE;
+            }
+            break;
+        }
+
+        case NEG_PROBE_SENT:
+            this->probe_failed();
+            break;
+
+        case NEG_WAIT_PROBE:
+        case NEG_WAIT_COMMIT:
+            // wait on the committed rate for the initiator to commit it again
+            this->switch_to(this->good_baud);
+            this->neg_state = NEG_WAIT_SWITCH;
+            this->wait_for((HDLC_NEG_RETRIES + 1) * HDLC_NEG_TIMEOUT_MS);
+            break;
+
+        case NEG_WAIT_SWITCH:
+            this->neg_state = NEG_DONE;
+            break;
+
+        default:
+            break;
+    }
+}
+
+bool HdlcNegotiator::done(void)
+{
+    return NEG_DONE == this->neg_state;
+}
+
+negotiate_state_t HdlcNegotiator::state(void)
+{
+    return this->neg_state;
+}
+
+uint32_t HdlcNegotiator::baud(void)
+{
+    return this->current_baud;
+}
+
+uint16_t HdlcNegotiator::frameLength(void)
+{
+    return this->frame_length;
+}
+
+char HdlcNegotiator::crc(void)
+{
+    return this->crc_variant;
+}
+
+bool HdlcNegotiator::hasFeature(char feature)
+{
+    return NULL != strchr(this->features, feature);
+}
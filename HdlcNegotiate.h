@@ -0,0 +1,180 @@
+#ifndef hdlcNegotiate_h
+#define hdlcNegotiate_h
+
+#include "ArduhdlcSw.h"
+
+/*
+Link capability and baud rate negotiation.
+
+Both ends start at the same base rate. The initiator (usually the host)
+calls begin():
+
+    N -> n      agree on min frame length, CRC variant, common features
+                and the lower of both max baud rates
+    A -> a      with the next higher rate, both switch to it
+    L.. -> l    initiator sends a burst of CRC checked probe frames of the
+                agreed frame length, responder reports how many arrived intact
+    A -> a      with the current rate commits it, from now on both ends
+                fall back to it
+    ...         repeat while every probe arrived
+
+'A' carries a sequence number that 'a' echoes. The initiator repeats
+unanswered requests up to HDLC_NEG_RETRIES times, and the responder answers
+a repeat again without acting on it twice. A short probe count or a
+timeout puts both ends back on the last committed rate, which the
+initiator then commits again to finish; an unanswered commit does the
+same. Only if that commit gets no answer either can the initiator not
+tell where the peer is, and it starts over at the base rate.
+
+While negotiating, frames stopping for HDLC_NEG_LINK_TIMEOUT_MS on a rate
+above the base rate put the link back at the base rate; afterwards that
+only happens after setLinkTimeout() ms. Negotiation frames and rate changes
+wait in poll() until the transmit queue is empty and no frame is half sent.
+Probes go through the transmit queue when it takes frameLength() frames, so
+hdlc.poll() sends them without blocking; otherwise poll() sends one probe
+per call with frameDecode().
+*/
+
+// CRC variants, SBR_FIELD_ID_CRC
+#define HDLC_NEG_CRC_CCITT_FALSE    'F'   // the only one ArduhdlcSw computes
+
+// Feature letters, SBR_FIELD_ID_FEATURES
+#define HDLC_NEG_FEATURE_COMPRESS   'Z'
+#define HDLC_NEG_FEATURE_BINARY     'X'
+
+#ifndef HDLC_NEG_PROBE_FRAMES
+#define HDLC_NEG_PROBE_FRAMES       8
+#endif
+
+#ifndef HDLC_NEG_TIMEOUT_MS
+#define HDLC_NEG_TIMEOUT_MS         500
+#endif
+
+// pause after a rate change before the first probe, lets the UART settle
+#ifndef HDLC_NEG_SETTLE_MS
+#define HDLC_NEG_SETTLE_MS          20
+#endif
+
+// repeats of an unanswered 'N' or 'A'
+#ifndef HDLC_NEG_RETRIES
+#define HDLC_NEG_RETRIES            3
+#endif
+
+// longer than any wait of the exchange itself
+#ifndef HDLC_NEG_LINK_TIMEOUT_MS
+#define HDLC_NEG_LINK_TIMEOUT_MS    5000
+#endif
+
+#define HDLC_NEG_FEATURES_LENGTH    8
+#define HDLC_NEG_MESSAGE_LENGTH     48    // longest 'N', 'n', 'A', 'a' or 'l'
+
+/* Must drain pending output (Serial.flush()) and then reopen the port */
+typedef void (* set_baud_type)(uint32_t baud);
+
+typedef enum
+{
+    NEG_IDLE = 0,
+    NEG_CAPS_SENT,          // initiator, waiting for 'n'
+    NEG_SWITCH_SENT,        // initiator, waiting for 'a' to a step up
+    NEG_SETTLE,             // initiator, switched, probes go out next
+    NEG_PROBING,            // initiator, probes going out
+    NEG_PROBE_SENT,         // initiator, waiting for 'l'
+    NEG_SETTLE_BACK,        // initiator, back on the committed rate, commits it again next
+    NEG_COMMIT_SENT,        // initiator, waiting for 'a' to a commit
+    NEG_RESTART,            // initiator, back on the base rate, begin() again next
+    NEG_WAIT_PROBE,         // responder, switched, counting probes
+    NEG_WAIT_COMMIT,        // responder, probes passed, waiting for the commit
+    NEG_WAIT_SWITCH,        // responder, rate committed, waiting for the next 'A'
+    NEG_DONE
+} negotiate_state_t;
+
+class HdlcNegotiator
+{
+  public:
+    HdlcNegotiator (ArduhdlcSw &hdlc, set_baud_type set_baud, clock_type clock, uint32_t base_baud);
+
+    /* What this end supports, before begin() or before the peer starts. */
+    /* max_frame_length counts the FCS, as given to ArduhdlcSw */
+    void setLocal(uint16_t max_frame_length, uint32_t max_baud, const char *features);
+    /* Drop back to base rate after this long without a frame, 0 = never */
+    void setLinkTimeout(uint32_t timeout_ms);
+
+    /* Initiator only, the responder just handles frames */
+    void begin(void);
+
+    /* Pass every frame from the frame handler, length includes the FCS. */
+    /* Returns true if it was a negotiation frame and is consumed */
+    bool handleFrame(const uint8_t *framebuffer, uint16_t framelength);
+
+    /* Call from loop(), sends replies, switches rates, drives timeouts */
+    /* and the probe burst */
+    void poll(void);
+
+    bool done(void);
+    negotiate_state_t state(void);
+    uint32_t baud(void);
+    /* Largest frame both ends take, FCS included, probed at every rate */
+    uint16_t frameLength(void);
+    char crc(void);
+    bool hasFeature(char feature);
+
+  private:
+    ArduhdlcSw &hdlc;
+    set_baud_type set_baud;
+    clock_type clock;
+
+    uint32_t base_baud;
+    uint32_t local_max_baud;
+    uint16_t local_frame_length;
+    char local_features[HDLC_NEG_FEATURES_LENGTH];
+
+    // agreed with the peer
+    uint32_t max_baud;
+    uint16_t frame_length;
+    char crc_variant;
+    char features[HDLC_NEG_FEATURES_LENGTH];
+
+    negotiate_state_t neg_state;
+    bool initiator;
+    uint32_t current_baud;
+    uint32_t good_baud;             // last committed rate
+    uint32_t request_baud;          // rate of the outstanding 'A'
+    uint32_t deadline;
+    uint32_t wait_ms;               // deadline, counted from the last flush()
+    uint32_t link_timeout;
+    uint32_t last_frame;
+    uint8_t probes_sent;
+    bool probes_direct;             // no queue for probes, frameDecode() them
+    uint8_t probes_received;
+    uint8_t seq;                    // of the last 'A' sent or answered
+    bool seq_valid;
+    char ack_status;                // answer to the last 'A', for repeats
+    uint8_t retries;
+    bool step_passed;               // the commit is for a rate that passed
+
+    // reply or request waiting for the link to go idle, then the rate change
+    char pending[HDLC_NEG_MESSAGE_LENGTH];
+    uint8_t pending_length;
+    bool switch_pending;
+
+    uint32_t now(void);
+    uint32_t next_rate(uint32_t baud);
+    bool negotiating(void);
+    bool tx_idle(void);
+    bool flush(void);
+    void wait_for(uint32_t ms);
+    void switch_to(uint32_t baud);
+    void restart(void);
+    void request(uint32_t baud, negotiate_state_t state);
+    void send_request(void);
+    void step_up(void);
+    void probe_failed(void);
+    void send_caps(char type, char status);
+    void send_status(char type, char status);
+    void send_probes(void);
+    uint8_t build_probe(char *frame, uint8_t seq);
+    uint8_t probe_payload(void);
+    uint32_t burst_time(void);
+};
+
+#endif
@@ -0,0 +1,426 @@
+/*
+SbrServer, reference SBR broker on top of ArduhdlcSw
+
+Resources live in a fixed table, found through an open addressing index
+keyed by an FNV-1a hash of the path. Every resource keeps the 'g' response
+for its last value, so a GET costs one lookup and one queue copy.
+*/
+
+#include "SbrServer.h"
+
+#define FNV_OFFSET_BASIS    2166136261UL
+#define FNV_PRIME           16777619UL
+
+// index entry of a deleted resource, keeps probe chains intact
+#define INDEX_TOMBSTONE     0xFF
+
+SbrServer::SbrServer (ArduhdlcSw &hdlc, clock_type clock) : hdlc(hdlc), clock(clock)
+{
+    memset(this->resources, 0, sizeof(this->resources));
+    memset(this->index, 0, sizeof(this->index));
+    memset(this->handlers, 0, sizeof(this->handlers));
+    memset(&this->counters, 0, sizeof(this->counters));
+    this->resource_count = 0;
+}
+
+// FNV-1a, never 0 so 0 can mark a free slot
+uint32_t SbrServer::hash(const char *path)
+{
+    uint32_t h = FNV_OFFSET_BASIS;
+    while (*path)
+    {
+        h ^= (uint8_t)*path++;
+        h *= FNV_PRIME;
+    }
+    return h ? h : 1;
+}
+
+// resource slot for path, -1 if not found
+int16_t SbrServer::lookup(const char *path, uint32_t path_hash)
+{
+    uint8_t position = path_hash % SBR_SERVER_INDEX_SIZE;
+
+    for (uint8_t probe = 0; probe < SBR_SERVER_INDEX_SIZE; probe++)
+    {
+        uint8_t entry = this->index[position];
+        if (0 == entry)
+        {
+            return -1;
+        }
+        if (INDEX_TOMBSTONE != entry)
+        {
+            sbr_resource_t *resource = &this->resources[entry - 1];
+            if ((resource->hash == path_hash) && (0 == strcmp(resource->path, path)))
+            {
+                return entry - 1;
+            }
+        }
+        position = (position + 1) % SBR_SERVER_INDEX_SIZE;
+    }
+    return -1;
+}
+
+// new resource, -1 if the table is full or the path too long
+int16_t SbrServer::create(char kind, char d_type, const char *path, const char *units)
+{
+    if ((this->resource_count == SBR_SERVER_MAX_RESOURCES) || (strlen(path) >= SBR_SERVER_PATH_LENGTH))
+    {
+        return -1;
+    }
+
+    int16_t slot = 0;
+    while (this->resources[slot].hash)
+    {
+        slot++;
+    }
+
+    sbr_resource_t *resource = &this->resources[slot];
+    memset(resource, 0, sizeof(sbr_resource_t));
+    resource->hash = this->hash(path);
+    resource->kind = kind;
+    resource->d_type = d_type;
+    strcpy(resource->path, path);
+    if (units)
+    {
+        strncpy(resource->units, units, SBR_SERVER_UNITS_LENGTH - 1);
+    }
+
+    uint8_t position = resource->hash % SBR_SERVER_INDEX_SIZE;
+    while ((0 != this->index[position]) && (INDEX_TOMBSTONE != this->index[position]))
+    {
+        position = (position + 1) % SBR_SERVER_INDEX_SIZE;
+    }
+    this->index[position] = slot + 1;
+    this->resource_count++;
+    return slot;
+}
+
+void SbrServer::remove(int16_t slot)
+{
+    uint8_t position = this->resources[slot].hash % SBR_SERVER_INDEX_SIZE;
+    while (this->index[position] != slot + 1)
+    {
+        position = (position + 1) % SBR_SERVER_INDEX_SIZE;
+    }
+    // a following empty entry ends every chain through here, no tombstone needed
+    if (0 == this->index[(position + 1) % SBR_SERVER_INDEX_SIZE])
+    {
+        this->index[position] = 0;
+    }
+    else
+    {
+        this->index[position] = INDEX_TOMBSTONE;
+    }
+
+    for (uint8_t i = 0; i < SBR_SERVER_MAX_HANDLERS; i++)
+    {
+        if (this->handlers[i].resource == slot + 1)
+        {
+            this->handlers[i].resource = 0;
+        }
+    }
+
+    this->resources[slot].hash = 0;
+    this->resource_count--;
+}
+
+void SbrServer::push(int16_t slot, char d_type, const char *time, const char *data)
+{
+    sbr_resource_t *resource = &this->resources[slot];
+
+    if (SBR_DATA_TYPE_UNDEF != d_type)
+    {
+        resource->d_type = d_type;
+    }
+    if (time)
+    {
+        resource->timestamp = strtoul(time, NULL, 10);
+    }
+    else
+    {
+        resource->timestamp = this->clock ? (*this->clock)() : 0;
+    }
+    strncpy(resource->value, data ? data : "", SBR_SERVER_VALUE_LENGTH - 1);
+    resource->value[SBR_SERVER_VALUE_LENGTH - 1] = 0;
+    resource->cache_length = 0;
+
+    this->notify(slot);
+}
+
+// fan out SBR_PKT_NTFY_HANDLER_CALL, local handlers first
+void SbrServer::notify(int16_t slot)
+{
+    sbr_resource_t *resource = &this->resources[slot];
+
+    for (uint8_t i = 0; i < SBR_SERVER_MAX_HANDLERS; i++)
+    {
+        if (this->handlers[i].resource == slot + 1)
+        {
+            (*this->handlers[i].handler)(resource->path, resource->d_type, resource->value, resource->timestamp);
+            this->counters.notifications++;
+        }
+    }
+
+    if (resource->notify_remote)
+    {
+        char frame[HDLC_TX_QUEUE_FRAME_LENGTH];
+        int length = snprintf(frame,
+                HDLC_TX_QUEUE_FRAME_LENGTH,
+                "%c%c%s%c%lu,%c%s,%c%s",
+                SBR_PKT_NTFY_HANDLER_CALL,
+                resource->d_type,
+                DEFAUT_ENCODE_SEGMENT,
+                SBR_FIELD_ID_TIME,
+                (unsigned long)resource->timestamp,
+                SBR_FIELD_ID_PATH,
+                resource->path,
+                SBR_FIELD_ID_DATA,
+                resource->value);
+        if (length >= HDLC_TX_QUEUE_FRAME_LENGTH)
+        {
+            length = HDLC_TX_QUEUE_FRAME_LENGTH - 1;
+        }
+        // the peer answers 'c' with 'C', like a request, so it stays out
+        // of the control queue that holds responses
+        this->send(frame, length, HDLC_TX_PRIORITY_NORMAL);
+        this->counters.notifications++;
+    }
+}
+
+// status only response: type status pad[2]
+void SbrServer::respond(char type, char status)
+{
+    char frame[4] = { type, status, DEFAUT_ENCODE_SEGMENT[0], DEFAUT_ENCODE_SEGMENT[1] };
+    this->send(frame, sizeof(frame), HDLC_TX_PRIORITY_CONTROL);
+}
+
+void SbrServer::send(const char *framebuffer, uint8_t frame_length, uint8_t priority)
+{
+    if (!this->hdlc.queueFrame(framebuffer, frame_length, priority))
+    {
+        this->counters.tx_dropped++;
+    }
+}
+
+void SbrServer::handleFrame(const uint8_t *framebuffer, uint16_t framelength)
+{
+    char request[HDLC_TX_QUEUE_FRAME_LENGTH + 1];
+    const char *path = NULL;
+    const char *units = NULL;
+    const char *time = NULL;
+    const char *data = NULL;
+
+    // drop the FCS
+    if (framelength <= 2)
+    {
+        return;
+    }
+    framelength -= 2;
+
+    // responses and notifications from the peer are not requests, answering
+    // them would make two servers answer each other's '?' forever
+    char type = (char)framebuffer[0];
+    if ((type >= 'a') && (type <= 'z'))
+    {
+        return;
+    }
+    switch (type)
+    {
+        case SBR_PKT_RESP_HANDLER_CALL:
+        case SBR_PKT_RESP_SENSOR_CALL:
+        case SBR_PKT_RESP_UNKNOWN_RQST:
+        case SBR_PKT_NTFY_NAK:
+            return;
+    }
+
+    if ((framelength < 4) || (framelength > HDLC_TX_QUEUE_FRAME_LENGTH))
+    {
+        this->counters.bad_requests++;
+        this->respond(SBR_PKT_RESP_UNKNOWN_RQST, SBR_STATUS_BAD_REQUEST);
+        return;
+    }
+    memcpy(request, framebuffer, framelength);
+    request[framelength] = 0;
+
+    char d_type = request[1];
+
+    this->counters.requests++;
+
+    // fields after byte 4, comma separated; data is last and may hold commas
+    char *field = request + 4;
+    while (*field)
+    {
+        char *next = NULL;
+        if (SBR_FIELD_ID_DATA != *field)
+        {
+            next = strchr(field, ',');
+            if (next)
+            {
+                *next++ = 0;
+            }
+        }
+        switch (*field)
+        {
+            case SBR_FIELD_ID_PATH:  path = field + 1;  break;
+            case SBR_FIELD_ID_UNITS: units = field + 1; break;
+            case SBR_FIELD_ID_TIME:  time = field + 1;  break;
+            case SBR_FIELD_ID_DATA:  data = field + 1;  break;
+        }
+        if (NULL == next)
+        {
+            break;
+        }
+        field = next;
+    }
+
+    char resp_type = (char)(type | 0x20);      // 'G' -> 'g'
+    if (NULL == path)
+    {
+        this->counters.bad_requests++;
+        this->respond(SBR_PKT_RESP_UNKNOWN_RQST, SBR_STATUS_BAD_REQUEST);
+        return;
+    }
+    int16_t slot = this->lookup(path, this->hash(path));
+
+    switch (type)
+    {
+        case SBR_PKT_RQST_GET:
+        {
+            if (slot < 0)
+            {
+                this->counters.not_found++;
+                this->respond(resp_type, SBR_STATUS_NOT_FOUND);
+                return;
+            }
+            sbr_resource_t *resource = &this->resources[slot];
+            if (resource->cache_length)
+            {
+                this->counters.get_cache_hits++;
+            }
+            else
+            {
+                // formatted aside, the value and the cache share the resource
+                char cache[SBR_SERVER_CACHE_LENGTH];
+                int length = snprintf(cache,
+                        sizeof(cache),
+                        "%c%c%s%c%lu,%c%s",
+                        SBR_PKT_RESP_GET,
+                        SBR_STATUS_OK,
+                        DEFAUT_ENCODE_SEGMENT,
+                        SBR_FIELD_ID_TIME,
+                        (unsigned long)resource->timestamp,
+                        SBR_FIELD_ID_DATA,
+                        resource->value);
+                resource->cache_length = (length < SBR_SERVER_CACHE_LENGTH) ? length : SBR_SERVER_CACHE_LENGTH - 1;
+                memcpy(resource->cache, cache, resource->cache_length + 1);
+            }
+            this->send(resource->cache, resource->cache_length, HDLC_TX_PRIORITY_CONTROL);
+            return;
+        }
+
+        case SBR_PKT_RQST_PUSH:
+        case SBR_PKT_RQST_EXAMPLE_SET:
+            if (slot < 0)
+            {
+                this->counters.not_found++;
+                this->respond(resp_type, SBR_STATUS_NOT_FOUND);
+                return;
+            }
+            this->push(slot, d_type, time, data);
+            this->respond(resp_type, SBR_STATUS_OK);
+            return;
+
+        case SBR_PKT_RQST_INPUT_CREATE:
+        case SBR_PKT_RQST_OUTPUT_CREATE:
+        case SBR_PKT_RQST_SENSOR_CREATE:
+            // creating an existing path is not an error
+            if ((slot < 0) && (this->create(type, d_type, path, units) < 0))
+            {
+                this->respond(resp_type, SBR_STATUS_NO_MEMORY);
+                return;
+            }
+            this->respond(resp_type, SBR_STATUS_OK);
+            return;
+
+        case SBR_PKT_RQST_DELETE:
+        case SBR_PKT_RQST_SENSOR_REMOVE:
+        case SBR_PKT_RQST_HANDLER_ADD:
+        case SBR_PKT_RQST_HANDLER_REMOVE:
+            if (slot < 0)
+            {
+                this->counters.not_found++;
+                this->respond(resp_type, SBR_STATUS_NOT_FOUND);
+                return;
+            }
+            if (SBR_PKT_RQST_HANDLER_ADD == type)
+            {
+                this->resources[slot].notify_remote = true;
+            }
+            else if (SBR_PKT_RQST_HANDLER_REMOVE == type)
+            {
+                this->resources[slot].notify_remote = false;
+            }
+            else
+            {
+                this->remove(slot);
+            }
+            this->respond(resp_type, SBR_STATUS_OK);
+            return;
+
+        default:
+            this->counters.bad_requests++;
+            this->respond(SBR_PKT_RESP_UNKNOWN_RQST, SBR_STATUS_BAD_REQUEST);
+            return;
+    }
+}
+
+bool SbrServer::addHandler(const char *path, sbr_handler_type handler)
+{
+    int16_t slot = this->lookup(path, this->hash(path));
+    if (slot < 0)
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < SBR_SERVER_MAX_HANDLERS; i++)
+    {
+        if (0 == this->handlers[i].resource)
+        {
+            this->handlers[i].resource = slot + 1;
+            this->handlers[i].handler = handler;
+            return true;
+        }
+    }
+    return false;
+}
+
+void SbrServer::removeHandler(const char *path, sbr_handler_type handler)
+{
+    int16_t slot = this->lookup(path, this->hash(path));
+    if (slot < 0)
+    {
+        return;
+    }
+    for (uint8_t i = 0; i < SBR_SERVER_MAX_HANDLERS; i++)
+    {
+        if ((this->handlers[i].resource == slot + 1) && (this->handlers[i].handler == handler))
+        {
+            this->handlers[i].resource = 0;
+        }
+    }
+}
+
+const sbr_resource_t * SbrServer::find(const char *path)
+{
+    int16_t slot = this->lookup(path, this->hash(path));
+    return (slot < 0) ? NULL : &this->resources[slot];
+}
+
+uint8_t SbrServer::resourceCount(void)
+{
+    return this->resource_count;
+}
+
+const sbr_server_stats_t * SbrServer::stats(void)
+{
+    return &this->counters;
+}
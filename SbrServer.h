@@ -0,0 +1,119 @@
+#ifndef sbrServer_h
+#define sbrServer_h
+
+#include "ArduhdlcSw.h"
+
+/*
+Reference SBR server (broker side). Feed it every decoded frame from the
+frame handler; it keeps the resource table, answers requests through the
+ArduhdlcSw transmit queue and fans out handler calls.
+
+Memory is fixed at compile time. Change the sizes here or with -D build
+flags, a #define in the sketch does not reach SbrServer.cpp.
+*/
+
+#ifndef SBR_SERVER_MAX_RESOURCES
+#define SBR_SERVER_MAX_RESOURCES    8
+#endif
+
+// index entries and their positions are uint8_t, 0xFF marks a tombstone
+static_assert(SBR_SERVER_MAX_RESOURCES <= 127, "SBR_SERVER_MAX_RESOURCES must be 127 or less");
+
+#ifndef SBR_SERVER_MAX_HANDLERS
+#define SBR_SERVER_MAX_HANDLERS     4     // local handler callbacks
+#endif
+
+#ifndef SBR_SERVER_PATH_LENGTH
+#define SBR_SERVER_PATH_LENGTH      32
+#endif
+
+#ifndef SBR_SERVER_UNITS_LENGTH
+#define SBR_SERVER_UNITS_LENGTH     8
+#endif
+
+#ifndef SBR_SERVER_VALUE_LENGTH
+#define SBR_SERVER_VALUE_LENGTH     32
+#endif
+
+// 'g' response: type status pad[2] T<time>,D<value>
+#define SBR_SERVER_CACHE_LENGTH     (4 + 12 + 2 + SBR_SERVER_VALUE_LENGTH)
+
+// Suggested setTxQueue() depth. A request queues one response at control
+// priority, a push to a path with a remote handler also a 'c' at normal
+// priority. Leaves room for requests that arrive between two poll() calls
+#define SBR_SERVER_TX_QUEUE_DEPTH   4
+
+// Open addressing path index, twice the resources keeps probe chains short
+#define SBR_SERVER_INDEX_SIZE       (SBR_SERVER_MAX_RESOURCES * 2)
+
+typedef void (* sbr_handler_type)(const char *path, char d_type, const char *data, uint32_t timestamp);
+
+typedef struct
+{
+    uint32_t hash;                              // of path, 0 when slot is free
+    char     kind;                              // SBR_PKT_RQST_*_CREATE
+    char     d_type;
+    bool     notify_remote;                     // peer sent SBR_PKT_RQST_HANDLER_ADD
+    uint8_t  cache_length;                      // 0 when cached 'g' frame is stale
+    uint32_t timestamp;
+    char     path[SBR_SERVER_PATH_LENGTH];
+    char     units[SBR_SERVER_UNITS_LENGTH];
+    char     value[SBR_SERVER_VALUE_LENGTH];
+    char     cache[SBR_SERVER_CACHE_LENGTH];    // pre-encoded SBR_PKT_RESP_GET
+} sbr_resource_t;
+
+typedef struct
+{
+    uint32_t requests;
+    uint32_t get_cache_hits;
+    uint32_t not_found;
+    uint32_t bad_requests;
+    uint32_t notifications;
+    uint32_t tx_dropped;                        // transmit queue was full
+} sbr_server_stats_t;
+
+class SbrServer
+{
+  public:
+    /* Responses go through the transmit queue, hdlc needs setTxQueue(), */
+    /* e.g. SBR_SERVER_TX_QUEUE_DEPTH deep */
+    SbrServer (ArduhdlcSw &hdlc, clock_type clock);
+
+    /* Pass frames from the frame handler as is, length includes the FCS */
+    void handleFrame(const uint8_t *framebuffer, uint16_t framelength);
+
+    /* Local handler, called on every push to path */
+    bool addHandler(const char *path, sbr_handler_type handler);
+    void removeHandler(const char *path, sbr_handler_type handler);
+
+    const sbr_resource_t * find(const char *path);
+    uint8_t resourceCount(void);
+    const sbr_server_stats_t * stats(void);
+
+  private:
+    ArduhdlcSw &hdlc;
+    clock_type clock;
+
+    sbr_resource_t resources[SBR_SERVER_MAX_RESOURCES];
+    uint8_t index[SBR_SERVER_INDEX_SIZE];       // resource slot + 1, 0 empty
+    uint8_t resource_count;
+
+    struct
+    {
+        uint8_t resource;                       // slot + 1, 0 unused
+        sbr_handler_type handler;
+    } handlers[SBR_SERVER_MAX_HANDLERS];
+
+    sbr_server_stats_t counters;
+
+    uint32_t hash(const char *path);
+    int16_t lookup(const char *path, uint32_t path_hash);
+    int16_t create(char kind, char d_type, const char *path, const char *units);
+    void remove(int16_t slot);
+    void push(int16_t slot, char d_type, const char *time, const char *data);
+    void notify(int16_t slot);
+    void respond(char type, char status);
+    void send(const char *framebuffer, uint8_t frame_length, uint8_t priority);
+};
+
+#endif
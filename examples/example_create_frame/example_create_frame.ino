@@ -18,6 +18,11 @@ void send_character(uint8_t data) {
     Serial.print((char)data);
 }
 
+/* Bytes Serial can take without blocking, lets hdlc.poll() return early */
+int tx_room() {
+    return Serial.availableForWrite();
+}
+
 /* Frame handler function. What to do with received data? */
 void hdlc_frame_handler(const uint8_t *data, uint16_t length) {
     // Do something with data that is in framebuffer
@@ -27,6 +32,9 @@ void setup() {
     pinMode(1,OUTPUT); // Serial port TX to output
     // initialize serial port to 9600 baud
     Serial.begin(9600);
+    // queue memory, only needed for queueFrame()
+    hdlc.setTxQueue(HDLC_TX_QUEUE_DEPTH, HDLC_TX_QUEUE_FRAME_LENGTH);
+    hdlc.setTxRoomFunction(&tx_room);
 }
 
 void loop() {
@@ -47,8 +55,12 @@ void loop() {
     // push resource
     hdlc.encode_push(SBR_DATA_TYPE_STRING, "path/to/push", "helloworld", my_frame);
     
-    // send to master
-    hdlc.frameDecode(my_frame, strlen(my_frame));
+    // send to master, poll() sends responses before bulk pushes and
+    // only writes what the serial buffer takes, so loop() never blocks.
+    // Without a queue, hdlc.frameDecode(my_frame, strlen(my_frame))
+    // sends it at once
+    hdlc.queueFrame(my_frame, strlen(my_frame));
+    hdlc.poll();
     delay(2000);
 }
 
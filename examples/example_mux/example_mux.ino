@@ -0,0 +1,75 @@
+#include "ArduhdlcSw.h"
+#include "HdlcMux.h"
+
+#define MAX_HDLC_FRAME_LENGTH 128
+
+#define CHANNEL_TELEMETRY   1
+#define CHANNEL_CONFIG      2
+#define CHANNEL_CONSOLE     3
+
+/* Function to send out byte/char */
+void send_character(uint8_t data);
+
+/* Function to handle a valid HDLC frame */
+void hdlc_frame_handler(const uint8_t *data, uint16_t length);
+
+ArduhdlcSw hdlc(&send_character, &hdlc_frame_handler, MAX_HDLC_FRAME_LENGTH);
+
+/* Channel layer on top of the link, one handler per channel */
+HdlcMux mux(hdlc, &millis);
+
+void send_character(uint8_t data) {
+    Serial.print((char)data);
+}
+
+int tx_room() {
+    return Serial.availableForWrite();
+}
+
+/* Every frame goes to the mux, it buffers it for its channel */
+void hdlc_frame_handler(const uint8_t *data, uint16_t length) {
+    mux.handleFrame(data, length);
+}
+
+void telemetry_handler(const uint8_t *data, uint16_t length) {
+    // telemetry from the peer
+}
+
+void config_handler(const uint8_t *data, uint16_t length) {
+    // configuration requests, answer on the same channel
+    mux.send(CHANNEL_CONFIG, "ok", 2);
+}
+
+void console_handler(const uint8_t *data, uint16_t length) {
+    // debug console input
+}
+
+void setup() {
+    pinMode(1,OUTPUT); // Serial port TX to output
+    Serial.begin(9600);
+    hdlc.setTxQueue(HDLC_TX_QUEUE_DEPTH, HDLC_TX_QUEUE_FRAME_LENGTH);
+    hdlc.setTxRoomFunction(&tx_room);
+
+    mux.openChannel(CHANNEL_TELEMETRY, &telemetry_handler, HDLC_TX_PRIORITY_BULK);
+    mux.openChannel(CHANNEL_CONFIG, &config_handler, HDLC_TX_PRIORITY_CONTROL);
+    mux.openChannel(CHANNEL_CONSOLE, &console_handler, HDLC_TX_PRIORITY_NORMAL);
+}
+
+void loop() {
+    char sample[16];
+
+    // send telemetry as fast as the peer takes it, send() fails when
+    // the peer has no free slot on this channel
+    snprintf(sample, sizeof(sample), "A0=%d", analogRead(A0));
+    mux.send(CHANNEL_TELEMETRY, sample, strlen(sample));
+
+    mux.poll();
+    hdlc.poll();
+}
+
+void serialEvent() {
+    while (Serial.available()) {
+        char inChar = (char)Serial.read();
+        hdlc.charReceiver(inChar);
+    }
+}
@@ -0,0 +1,62 @@
+#include "ArduhdlcSw.h"
+#include "HdlcNegotiate.h"
+
+#define MAX_HDLC_FRAME_LENGTH 128
+#define BASE_BAUD             9600
+
+/* Function to send out byte/char */
+void send_character(uint8_t data);
+
+/* Function to handle a valid HDLC frame */
+void hdlc_frame_handler(const uint8_t *data, uint16_t length);
+
+/* Reopen the serial port at a new rate */
+void set_baud(uint32_t baud);
+
+ArduhdlcSw hdlc(&send_character, &hdlc_frame_handler, MAX_HDLC_FRAME_LENGTH);
+
+/* Device side answers the host's negotiation, starting from BASE_BAUD */
+HdlcNegotiator negotiator(hdlc, &set_baud, &millis, BASE_BAUD);
+
+void send_character(uint8_t data) {
+    Serial.write(data);
+}
+
+void set_baud(uint32_t baud) {
+    // everything sent so far must leave at the old rate
+    Serial.flush();
+    Serial.end();
+    Serial.begin(baud);
+}
+
+void hdlc_frame_handler(const uint8_t *data, uint16_t length) {
+    if (negotiator.handleFrame(data, length)) {
+        return;
+    }
+    // application frames
+}
+
+void setup() {
+    pinMode(1,OUTPUT); // Serial port TX to output
+    Serial.begin(BASE_BAUD);
+
+    // receive buffer size (FCS included), fastest rate this board handles, no optional features
+    negotiator.setLocal(MAX_HDLC_FRAME_LENGTH, 115200, "");
+    // the host sends something at least every second, otherwise go back to BASE_BAUD
+    negotiator.setLinkTimeout(3000);
+}
+
+void loop() {
+    negotiator.poll();
+
+    if (negotiator.done()) {
+        // negotiator.frameLength() is the largest frame both ends take
+    }
+}
+
+void serialEvent() {
+    while (Serial.available()) {
+        char inChar = (char)Serial.read();
+        hdlc.charReceiver(inChar);
+    }
+}
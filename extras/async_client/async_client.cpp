@@ -0,0 +1,144 @@
+/*
+Host example for ArduhdlcSwAsync.h
+
+Build from the library root:
+    g++ -std=c++20 -I. extras/async_client/async_client.cpp ArduhdlcSw.cpp -o async_client
+
+A socketpair stands in for the serial line; the other end is a fake device
+that answers every SBR_PKT_RQST_GET with a 'g' frame, in order like a real
+device, paths under "slow/" taking 200 ms. Pushes are ignored, so the push
+below times out, and anything else gets a '?'.
+*/
+
+#include "ArduhdlcSwAsync.h"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <vector>
+
+using namespace arduhdlc;
+using namespace std::chrono_literals;
+
+static EventLoop * device_loop = nullptr;
+static EventLoop::Clock::time_point device_free;   // earlier answers still to go
+static int device_fd = -1;
+static std::vector<uint8_t> device_out;
+static void device_sendchar(uint8_t data);
+static void device_frame_handler(const uint8_t *data, uint16_t length);
+static ArduhdlcSw device(&device_sendchar, &device_frame_handler, 256);
+
+static void device_sendchar(uint8_t data)
+{
+    device_out.push_back(data);
+}
+
+static void device_events(EventLoop & loop, short revents)
+{
+    if (revents & POLLIN)
+    {
+        uint8_t buffer[256];
+        ssize_t n = read(device_fd, buffer, sizeof(buffer));
+        for (ssize_t i = 0; i < n; i++) device.charReceiver(buffer[i]);
+    }
+    if (!device_out.empty())
+    {
+        ssize_t n = write(device_fd, device_out.data(), device_out.size());
+        if (n > 0) device_out.erase(device_out.begin(), device_out.begin() + n);
+    }
+    loop.setEvents(device_fd, device_out.empty() ? POLLIN : (POLLIN | POLLOUT));
+}
+
+static void device_frame_handler(const uint8_t *data, uint16_t length)
+{
+    char path[128] = {0};
+    char frame[128] = {0};
+    char request[128] = {0};
+    memcpy(request, data, length - 2);
+
+    char type = device.get_resp_package_type(request);
+    if (SBR_PKT_RQST_GET == type && device.get_resp_path(request, length - 2, path))
+    {
+        int n = snprintf(frame, sizeof(frame), "%c0%sT%d,D%s-value", SBR_PKT_RESP_GET, DEFAUT_ENCODE_SEGMENT, 1234, path);
+        std::string response(frame, n);
+        auto answer = [response] {
+            device.frameDecode(response.data(), (uint8_t)response.size());
+            device_events(*device_loop, 0);
+        };
+        EventLoop::Clock::time_point now = EventLoop::Clock::now();
+        device_free = std::max(device_free, now) + (0 == strncmp(path, "slow/", 5) ? 200ms : 0ms);
+        if (device_free > now)
+        {
+            device_loop->addTimer(device_free - now, answer);
+        }
+        else
+        {
+            answer();
+        }
+    }
+    else if (SBR_PKT_RQST_PUSH != type)
+    {
+        int n = snprintf(frame, sizeof(frame), "%c%c%s", SBR_PKT_RESP_UNKNOWN_RQST, SBR_STATUS_BAD_REQUEST, DEFAUT_ENCODE_SEGMENT);
+        device.frameDecode(frame, n);
+    }
+}
+
+static Task<void> client(Link & link, EventLoop & loop)
+{
+    Response v = co_await link.get("path/to/get");
+    printf("get: status %d data '%s' time '%s'\n", (int)v.status, v.data.c_str(), v.timestamp.c_str());
+
+    char frame[128];
+    char path[] = "path/to/set";
+    char value[] = "1";
+    link.hdlc().encode_example(SBR_DATA_TYPE_STRING, path, value, frame);
+    Response e = co_await link.request(frame);
+    printf("example set: status %d (rejected expected)\n", (int)e.status);
+
+    Response p = co_await link.push(SBR_DATA_TYPE_STRING, "path/to/push", "hello", 100ms);
+    printf("push: status %d (timeout expected)\n", (int)p.status);
+
+    CancelSource cancel;
+    loop.addTimer(10ms, [&cancel] { cancel.cancel(); });
+    Response c = co_await link.push(SBR_DATA_TYPE_STRING, "path/to/push", "hello", 1s, cancel.token());
+    printf("push: status %d (cancelled expected)\n", (int)c.status);
+
+    // the late 'g' for slow/1 goes to its placeholder, not to the next get
+    Response s = co_await link.get("slow/1", 50ms);
+    Response f = co_await link.get("path/after/timeout");
+    printf("get: status %d (timeout expected), then '%s'\n", (int)s.status, f.data.c_str());
+}
+
+/* Many requests in flight at once, one coroutine each, no threads */
+static Task<void> one_get(Link & link, int i, int & ok)
+{
+    char path[32];
+    snprintf(path, sizeof(path), "sensor/%d", i);
+    Response v = co_await link.get(path);
+    if (Status::Ok == v.status && v.data == std::string(path) + "-value") ok++;
+}
+
+int main()
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) return 1;
+    fcntl(sv[0], F_SETFL, O_NONBLOCK);
+    fcntl(sv[1], F_SETFL, O_NONBLOCK);
+    device_fd = sv[1];
+
+    EventLoop loop;
+    Link link(loop, sv[0]);
+    device_loop = &loop;
+
+    loop.watch(device_fd, POLLIN, [&loop](short revents) { device_events(loop, revents); });
+
+    loop.spawn(client(link, loop));
+    loop.run();
+
+    const int count = 1000;
+    int ok = 0;
+    for (int i = 0; i < count; i++) loop.spawn(one_get(link, i, ok));
+    loop.run();
+    printf("concurrent gets: %d/%d ok\n", ok, count);
+
+    return ok == count ? 0 : 1;
+}
@@ -0,0 +1,284 @@
+/*
+Noise injection harness for the ArduhdlcSw receiver
+
+Build from the library root:
+    g++ -O2 -I. extras/noise_harness/noise_harness.cpp ArduhdlcSw.cpp -o noise_harness
+
+Frames of random length and content (rich in 0x7E / 0x7D) are framed with
+frameDecode(), bits are flipped at a given bit error rate and every few
+frames a burst of flagless line garbage is inserted.
+
+Stream:  the damaged stream goes once through charReceiver() and through a
+         copy of the previous receiver, which restarted at position 0 when
+         the buffer filled and so offered garbage tails as frames ("false").
+         Both deliver the same frames, the hardened one hunts instead.
+ARQ:     stop-and-wait, each frame is resent until it arrives. Without NAK
+         the sender only learns of a loss after a timeout, with NAK it
+         resends as soon as the receiver reports the bad frame.
+
+Goodput is payload octets of intact delivered frames per octet of line
+time, timeouts and NAK turnaround included.
+*/
+
+#include "ArduhdlcSw.h"
+
+#include <random>
+#include <vector>
+
+#define FRAMES              20000
+#define ARQ_FRAMES          2000
+#define MAX_FRAME_LENGTH    128
+#define GARBAGE_EVERY       50      // frames between line garbage bursts
+#define TIMEOUT_OCTETS      256     // line time lost waiting for a missing ack
+#define NAK_OCTETS          8       // NAK frame and turnaround
+
+typedef std::vector<uint8_t> bytes_t;
+
+static std::mt19937 rng(12345);
+static std::vector<bytes_t> sent;
+static std::vector<bytes_t> lines;     // each frame as framed, garbage included
+static bytes_t wire;
+
+static uint32_t delivered_ok;
+static uint32_t delivered_bad;      // passed the FCS but differ from what was sent
+static uint64_t goodput_octets;
+static int32_t last_seq;
+static uint32_t naks;
+
+static void wire_sendchar(uint8_t data) { wire.push_back(data); }
+static void nak_sendchar(uint8_t data) { if (0x7E == data) naks++; }
+static void no_frames(const uint8_t *, uint16_t) {}
+
+static void reset_counts(void)
+{
+    delivered_ok = delivered_bad = 0;
+    goodput_octets = 0;
+    last_seq = -1;
+}
+
+/* first two payload bytes carry the frame number */
+static void check_frame(const uint8_t *data, uint16_t length)
+{
+    uint16_t payload = length - 2;
+    if (payload < 2)
+    {
+        delivered_bad++;
+        return;
+    }
+    uint16_t seq = data[0] | (data[1] << 8);
+    if ((seq < sent.size()) && (sent[seq].size() == payload) && (0 == memcmp(sent[seq].data(), data, payload)))
+    {
+        delivered_ok++;
+        goodput_octets += payload;
+        last_seq = seq;
+    }
+    else
+    {
+        delivered_bad++;
+    }
+}
+
+/* The receiver as it was before the hunt state, for comparison */
+class LegacyReceiver
+{
+  public:
+    uint32_t crc_errors = 0;
+
+    void charReceiver(uint8_t data)
+    {
+        if (0x7E == data)
+        {
+            if (escape)
+            {
+                escape = false;
+            }
+            else if (position >= 2)
+            {
+                uint16_t fcs = 0xFFFF;
+                for (uint16_t i = 0; i < position - 2; i++)
+                {
+                    fcs ^= (uint16_t)buffer[i] << 8;
+                    for (uint8_t b = 0; b < 8; b++) fcs = (fcs & 0x8000) ? (fcs << 1) ^ 0x1021 : fcs << 1;
+                }
+                if (fcs == (buffer[position - 1] | (buffer[position - 2] << 8)))
+                {
+                    check_frame(buffer, position);
+                }
+                else
+                {
+                    crc_errors++;
+                }
+            }
+            position = 0;
+            return;
+        }
+        if (escape)
+        {
+            escape = false;
+            data ^= 0x20;
+        }
+        else if (0x7D == data)
+        {
+            escape = true;
+            return;
+        }
+        buffer[position++] = data;
+        if (MAX_FRAME_LENGTH == position)
+        {
+            position = 0;
+        }
+    }
+
+  private:
+    uint8_t buffer[MAX_FRAME_LENGTH + 1];
+    uint16_t position = 0;
+    bool escape = false;
+};
+
+static bytes_t encode(const bytes_t &frame)
+{
+    static ArduhdlcSw sender(&wire_sendchar, &no_frames, MAX_FRAME_LENGTH);
+    wire.clear();
+    sender.frameDecode((const char *)frame.data(), frame.size());
+    return wire;
+}
+
+/* idle line noise: no flags, half the bursts end in an escape */
+static void add_garbage(bytes_t &line)
+{
+    uint32_t length = rng() % (3 * MAX_FRAME_LENGTH);
+    for (uint32_t i = 0; i < length; i++)
+    {
+        uint8_t b = (uint8_t)rng();
+        line.push_back(0x7E == b ? 0x00 : b);
+    }
+    if (rng() & 1) line.push_back(0x7D);
+}
+
+/* flip bits at the given rate, geometric gaps keep it fast */
+static void add_bit_errors(bytes_t &line, double ber)
+{
+    if (ber <= 0)
+    {
+        return;
+    }
+    std::geometric_distribution<uint64_t> gap(ber);
+    for (uint64_t bit = gap(rng); bit < line.size() * 8; bit += 1 + gap(rng))
+    {
+        line[bit / 8] ^= 1 << (bit % 8);
+    }
+}
+
+static void stream_run(const bytes_t &clean, double ber)
+{
+    bytes_t noisy = clean;
+    add_bit_errors(noisy, ber);
+
+    reset_counts();
+    LegacyReceiver legacy;
+    for (uint8_t b : noisy) legacy.charReceiver(b);
+    uint32_t legacy_ok = delivered_ok;
+    double legacy_goodput = (double)goodput_octets / noisy.size();
+
+    reset_counts();
+    ArduhdlcSw receiver(&nak_sendchar, &check_frame, MAX_FRAME_LENGTH);
+    for (uint8_t b : noisy) receiver.charReceiver(b);
+    const rx_stats_t *stats = receiver.rxStats();
+
+    printf("%8.0e | %6u %7.4f %6u | %6u %7.4f %6u %3u %6u %5u\n",
+           ber, legacy_ok, legacy_goodput, legacy.crc_errors,
+           delivered_ok, (double)goodput_octets / noisy.size(), stats->crc_errors,
+           delivered_bad, stats->aborts, stats->overflows);
+}
+
+static void arq_run(double ber, bool nak, double *goodput, double *attempts)
+{
+    ArduhdlcSw receiver(&nak_sendchar, &check_frame, MAX_FRAME_LENGTH);
+    receiver.setTxQueue(HDLC_TX_QUEUE_DEPTH, 4);
+    receiver.setNak(nak);
+    rng.seed((uint32_t)(ber * 1e9));
+    reset_counts();
+    naks = 0;
+
+    uint64_t line_octets = 0;
+    uint32_t tries = 0;
+    for (uint16_t seq = 0; seq < ARQ_FRAMES; seq++)
+    {
+        do
+        {
+            bytes_t noisy = lines[seq];
+            add_bit_errors(noisy, ber);
+            tries++;
+            line_octets += noisy.size();
+
+            // a NAK raised by the opening flag belongs to the previous attempt
+            receiver.charReceiver(noisy[0]);
+            receiver.poll();
+            uint32_t naks_before = naks;
+            for (size_t i = 1; i < noisy.size(); i++)
+            {
+                receiver.charReceiver(noisy[i]);
+                receiver.poll();
+            }
+
+            if (last_seq == seq)
+            {
+                break;
+            }
+            line_octets += (naks != naks_before) ? NAK_OCTETS : TIMEOUT_OCTETS;
+        } while (true);
+    }
+    *goodput = (double)goodput_octets / line_octets;
+    *attempts = (double)tries / ARQ_FRAMES;
+}
+
+int main()
+{
+    bytes_t clean;
+    for (uint16_t seq = 0; seq < FRAMES; seq++)
+    {
+        bytes_t frame(4 + rng() % 100);
+        frame[0] = seq & 0xFF;
+        frame[1] = seq >> 8;
+        for (size_t i = 2; i < frame.size(); i++)
+        {
+            uint32_t r = rng() % 16;
+            frame[i] = (0 == r) ? 0x7E : (1 == r) ? 0x7D : (uint8_t)rng();
+        }
+        sent.push_back(frame);
+
+        bytes_t line = encode(frame);
+        if (0 == seq % GARBAGE_EVERY) add_garbage(line);
+        clean.insert(clean.end(), line.begin(), line.end());
+        lines.push_back(line);
+    }
+
+    uint64_t payload_total = 0;
+    for (const bytes_t &frame : sent) payload_total += frame.size();
+
+    const double rates[] = { 0, 1e-6, 1e-5, 1e-4, 3e-4, 1e-3, 3e-3, 1e-2 };
+
+    printf("Stream: %u frames, %zu line octets, ideal goodput %.4f\n", FRAMES, clean.size(), (double)payload_total / clean.size());
+    printf("         |        legacy         |                 hardened\n");
+    printf("     BER |     ok goodput  false |     ok goodput    crc bad  abort   ovf\n");
+    for (double ber : rates)
+    {
+        stream_run(clean, ber);
+    }
+
+    // beyond 3e-3 a 100 octet frame almost never gets through
+    printf("\nStop-and-wait ARQ: %u frames, timeout %u octets, NAK %u octets\n", ARQ_FRAMES, TIMEOUT_OCTETS, NAK_OCTETS);
+    printf("     BER |  timeout  tries |      NAK  tries\n");
+    for (double ber : rates)
+    {
+        if (ber > 3e-3)
+        {
+            break;
+        }
+        double timeout_goodput, timeout_tries, nak_goodput, nak_tries;
+        arq_run(ber, false, &timeout_goodput, &timeout_tries);
+        arq_run(ber, true, &nak_goodput, &nak_tries);
+        printf("%8.0e | %8.4f %6.3f | %8.4f %6.3f\n", ber, timeout_goodput, timeout_tries, nak_goodput, nak_tries);
+    }
+    return 0;
+}
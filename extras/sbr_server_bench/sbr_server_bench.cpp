@@ -0,0 +1,121 @@
+/*
+Load benchmark for SbrServer on the host
+
+Build from the library root:
+    g++ -O2 -DSBR_SERVER_MAX_RESOURCES=64 -I. extras/sbr_server_bench/sbr_server_bench.cpp SbrServer.cpp ArduhdlcSw.cpp -o sbr_server_bench
+
+Wire frames for a GET/PUSH mix are prepared once, then fed byte by byte
+through charReceiver(), so the figure covers HDLC decode, CRC check,
+request dispatch and the framed response. PIPELINE requests arrive between
+two poll() calls, and the peer has a handler on one path in eight, so some
+pushes queue a 'c' as well; "dropped" counts responses lost to a full queue.
+*/
+
+#include "SbrServer.h"
+
+#include <chrono>
+#include <vector>
+
+#define RESOURCES       SBR_SERVER_MAX_RESOURCES
+#define REQUESTS        1000000
+#define PUSH_EVERY      5               // one push per 5 requests
+#define PIPELINE        4               // requests per poll() drain
+#define REMOTE_EVERY    8               // peer handler on one path in 8
+
+static std::vector<uint8_t> wire;
+static uint32_t tx_bytes = 0;
+static uint32_t notify_calls = 0;
+
+static void client_sendchar(uint8_t data) { wire.push_back(data); }
+static void client_frame_handler(const uint8_t *, uint16_t) {}
+static ArduhdlcSw client(&client_sendchar, &client_frame_handler, 256);
+
+static void server_sendchar(uint8_t) { tx_bytes++; }
+static void server_frame_handler(const uint8_t *data, uint16_t length);
+static ArduhdlcSw server_hdlc(&server_sendchar, &server_frame_handler, 256);
+static SbrServer server(server_hdlc, NULL);
+
+static void server_frame_handler(const uint8_t *data, uint16_t length)
+{
+    server.handleFrame(data, length);
+}
+
+static void on_push(const char *, char, const char *, uint32_t)
+{
+    notify_calls++;
+}
+
+/* wire bytes of each request, framed once up front */
+static std::vector<uint8_t> frame(char *request)
+{
+    wire.clear();
+    client.frameDecode(request, strlen(request));
+    return wire;
+}
+
+static void feed(const std::vector<uint8_t> &bytes)
+{
+    for (uint8_t b : bytes) server_hdlc.charReceiver(b);
+}
+
+static void drain(void)
+{
+    while (server_hdlc.poll());
+}
+
+int main()
+{
+    char request[128];
+    char path[32];
+    char data[16];
+    std::vector<std::vector<uint8_t>> gets, pushes;
+
+    server_hdlc.setTxQueue(SBR_SERVER_TX_QUEUE_DEPTH, HDLC_TX_QUEUE_FRAME_LENGTH);
+
+    for (int i = 0; i < RESOURCES; i++)
+    {
+        snprintf(path, sizeof(path), "sensor/%d/value", i);
+        client.encode_create((char *)"sensor", SBR_DATA_TYPE_NUMERIC, path, (char *)"volt", request);
+        feed(frame(request));
+        drain();
+
+        if (0 == i % REMOTE_EVERY)
+        {
+            client.encode_add((char *)"handler", path, request);
+            feed(frame(request));
+            drain();
+        }
+
+        snprintf(data, sizeof(data), "%d.5", i);
+        client.encode_push(SBR_DATA_TYPE_NUMERIC, path, data, request);
+        pushes.push_back(frame(request));
+
+        client.encode_get(path, request);
+        gets.push_back(frame(request));
+    }
+    server.addHandler("sensor/0/value", &on_push);
+    printf("pipeline: %d requests per poll(), transmit queue depth %d\n", PIPELINE, SBR_SERVER_TX_QUEUE_DEPTH);
+    printf("resources: %d, sbr_resource_t %zu bytes, server %zu bytes\n",
+           server.resourceCount(), sizeof(sbr_resource_t), sizeof(SbrServer));
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < REQUESTS; i++)
+    {
+        uint32_t r = (i * 2654435761UL) % RESOURCES;
+        feed((i % PUSH_EVERY) ? gets[r] : pushes[r]);
+        if (PIPELINE - 1 == i % PIPELINE)
+        {
+            drain();
+        }
+    }
+    drain();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const sbr_server_stats_t *stats = server.stats();
+    printf("requests: %lu in %.3f s, %.0f req/s\n", (unsigned long)stats->requests, seconds, stats->requests / seconds);
+    printf("get cache hits: %lu, not found: %lu, bad: %lu, dropped: %lu\n",
+           (unsigned long)stats->get_cache_hits, (unsigned long)stats->not_found,
+           (unsigned long)stats->bad_requests, (unsigned long)stats->tx_dropped);
+    printf("local handler calls: %lu, response bytes: %lu\n", (unsigned long)notify_calls, (unsigned long)tx_bytes);
+    return 0;
+}